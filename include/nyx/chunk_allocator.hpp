@@ -0,0 +1,390 @@
+//
+// Created by loki7 on 25-7-8.
+//
+
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <nyx/common.h>
+
+#if defined __linux__
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace nyx::ecs::detail
+{
+    struct numa_topology
+    {
+        size_type node_count{1};
+        std::vector<size_type> cpu_node_list{};
+        bool fake{false};
+
+        [[nodiscard]] size_type get_cpu_node(size_type cpu) const;
+        [[nodiscard]] size_type get_current_node() const;
+        [[nodiscard]] std::vector<size_type> get_node_cpu_list(size_type node) const;
+
+        // reads /sys/devices/system/node on linux, every other platform reports a single node.
+        static numa_topology detect();
+
+        // a topology that only exists on paper: nodes are never bound, cpus are never pinned.
+        static numa_topology create_fake(size_type node_count, size_type cpu_per_node);
+    };
+
+
+    struct chunk_allocator
+    {
+        virtual ~chunk_allocator() = default;
+
+        // picks the node the chunk_index-th chunk of a table should live on, invalid_id when unknown.
+        virtual size_type select_node(size_type chunk_index) = 0;
+        virtual std::byte* allocate(size_type bytes, size_type node) = 0;
+        virtual void deallocate(std::byte* data, size_type bytes) = 0;
+    };
+
+
+    enum class chunk_placement
+    {
+        first_touch,
+        interleave,
+        fixed,
+    };
+
+
+    // maps chunks straight from the kernel: interleave and fixed bind the pages to their node with mbind,
+    // first_touch leaves placement to whichever thread writes the chunk first. with huge_pages set, every mapping is
+    // aligned to huge_page_size and advised as transparent huge pages: chunks of at least that size get their own,
+    // smaller ones are carved out of shared slabs.
+    class numa_chunk_allocator final : public chunk_allocator
+    {
+    public:
+        static constexpr size_type huge_page_size = 2 * 1024 * 1024;
+
+        explicit numa_chunk_allocator(numa_topology topology, chunk_placement placement = chunk_placement::interleave,
+                                      size_type node = 0, bool huge_pages = false);
+        ~numa_chunk_allocator() override;
+
+        numa_chunk_allocator(const numa_chunk_allocator&) = delete;
+        numa_chunk_allocator& operator=(const numa_chunk_allocator&) = delete;
+
+        size_type select_node(size_type chunk_index) override;
+        std::byte* allocate(size_type bytes, size_type node) override;
+        void deallocate(std::byte* data, size_type bytes) override;
+
+        [[nodiscard]] const numa_topology& topology() const;
+
+    private:
+        // one huge page holding chunks of a single node and size. freed chunks wait for the next chunk of the same
+        // node and size, the slab itself is only unmapped with the allocator.
+        struct slab
+        {
+            std::byte* data;
+            size_type node;
+            size_type bytes;
+            size_type used;
+            std::vector<std::byte*> free_list;
+        };
+
+        numa_topology topology_;
+        chunk_placement placement_;
+        size_type node_;
+        bool huge_pages_;
+        std::mutex slab_mutex_;
+        std::vector<slab> slab_list_{};
+
+        [[nodiscard]] size_type get_mapping_size(size_type bytes) const;
+        [[nodiscard]] bool use_slab(size_type bytes) const;
+        std::byte* map(size_type mapping_size, bool huge, size_type node) const;
+        std::byte* allocate_slab_chunk(size_type bytes, size_type node);
+        void deallocate_slab_chunk(std::byte* data);
+    };
+
+
+    inline size_type numa_topology::get_cpu_node(const size_type cpu) const
+    {
+        return cpu < cpu_node_list.size() ? cpu_node_list[cpu] : 0;
+    }
+
+    inline size_type numa_topology::get_current_node() const
+    {
+#if defined __linux__
+        if (const auto cpu = sched_getcpu(); !fake && cpu >= 0)
+        {
+            return get_cpu_node(static_cast<size_type>(cpu));
+        }
+#endif
+        return 0;
+    }
+
+    inline std::vector<size_type> numa_topology::get_node_cpu_list(const size_type node) const
+    {
+        std::vector<size_type> cpu_list;
+
+        for (size_type cpu = 0; cpu < cpu_node_list.size(); cpu++)
+        {
+            if (cpu_node_list[cpu] == node)
+            {
+                cpu_list.push_back(cpu);
+            }
+        }
+
+        return cpu_list;
+    }
+
+    inline numa_topology numa_topology::detect()
+    {
+        numa_topology topology;
+        topology.cpu_node_list.assign(std::max(1u, std::thread::hardware_concurrency()), 0);
+
+#if defined __linux__
+        size_type node_count = 0;
+
+        for (size_type node = 0;; node++)
+        {
+            std::ifstream stream("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+
+            if (!stream)
+            {
+                break;
+            }
+
+            std::string cpu_list;
+            std::getline(stream, cpu_list);
+            node_count++;
+
+            // cpulist looks like "0-3,8-11"
+            for (size_type begin = 0; begin < cpu_list.size();)
+            {
+                auto end = cpu_list.find(',', begin);
+                end = end == std::string::npos ? cpu_list.size() : end;
+
+                const auto range = cpu_list.substr(begin, end - begin);
+                const auto dash = range.find('-');
+                const auto first = std::stoul(range.substr(0, dash));
+                const auto last = dash == std::string::npos ? first : std::stoul(range.substr(dash + 1));
+
+                if (topology.cpu_node_list.size() <= last)
+                {
+                    topology.cpu_node_list.resize(last + 1, 0);
+                }
+
+                for (auto cpu = first; cpu <= last; cpu++)
+                {
+                    topology.cpu_node_list[cpu] = node;
+                }
+
+                begin = end + 1;
+            }
+        }
+
+        topology.node_count = std::max<size_type>(node_count, 1);
+#endif
+
+        return topology;
+    }
+
+    inline numa_topology numa_topology::create_fake(const size_type node_count, const size_type cpu_per_node)
+    {
+        numa_topology topology{.node_count = node_count, .fake = true};
+
+        for (size_type cpu = 0; cpu < node_count * cpu_per_node; cpu++)
+        {
+            topology.cpu_node_list.push_back(cpu / cpu_per_node);
+        }
+
+        return topology;
+    }
+
+
+    inline numa_chunk_allocator::numa_chunk_allocator(numa_topology topology, const chunk_placement placement,
+                                                      const size_type node, const bool huge_pages) :
+        topology_(std::move(topology)), placement_(placement), node_(node), huge_pages_(huge_pages)
+    {
+    }
+
+    inline size_type numa_chunk_allocator::select_node(const size_type chunk_index)
+    {
+        switch (placement_)
+        {
+            case chunk_placement::interleave:
+            {
+                return chunk_index % topology_.node_count;
+            }
+            case chunk_placement::fixed:
+            {
+                return node_;
+            }
+            case chunk_placement::first_touch:
+            default:
+            {
+                return topology_.get_current_node();
+            }
+        }
+    }
+
+    inline numa_chunk_allocator::~numa_chunk_allocator()
+    {
+#if defined __linux__
+        for (const auto& current : slab_list_)
+        {
+            munmap(current.data, huge_page_size);
+        }
+#endif
+    }
+
+    inline std::byte* numa_chunk_allocator::allocate(const size_type bytes, const size_type node)
+    {
+#if defined __linux__
+        if (use_slab(bytes))
+        {
+            return allocate_slab_chunk(bytes, node);
+        }
+
+        return map(get_mapping_size(bytes), huge_pages_, node);
+#else
+        (void)node;
+        return static_cast<std::byte*>(::operator new[](bytes, std::align_val_t{chunk_alignment}));
+#endif
+    }
+
+    inline void numa_chunk_allocator::deallocate(std::byte* data, const size_type bytes)
+    {
+#if defined __linux__
+        if (use_slab(bytes))
+        {
+            deallocate_slab_chunk(data);
+            return;
+        }
+
+        munmap(data, get_mapping_size(bytes));
+#else
+        (void)bytes;
+        ::operator delete[](data, std::align_val_t{chunk_alignment});
+#endif
+    }
+
+    inline const numa_topology& numa_chunk_allocator::topology() const { return topology_; }
+
+    inline size_type numa_chunk_allocator::get_mapping_size(const size_type bytes) const
+    {
+        if (huge_pages_)
+        {
+            return (bytes + huge_page_size - 1) / huge_page_size * huge_page_size;
+        }
+
+#if defined __linux__
+        const auto page_size = static_cast<size_type>(sysconf(_SC_PAGESIZE));
+#else
+        constexpr size_type page_size = 4096;
+#endif
+
+        return (bytes + page_size - 1) / page_size * page_size;
+    }
+
+    inline bool numa_chunk_allocator::use_slab(const size_type bytes) const
+    {
+#if defined __linux__
+        return huge_pages_ && bytes < huge_page_size;
+#else
+        (void)bytes;
+        return false;
+#endif
+    }
+
+#if defined __linux__
+    inline std::byte* numa_chunk_allocator::map(const size_type mapping_size, const bool huge,
+                                                const size_type node) const
+    {
+        const auto reserve_size = huge ? mapping_size + huge_page_size : mapping_size;
+
+        auto data = static_cast<std::byte*>(
+            mmap(nullptr, reserve_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+
+        if (data == MAP_FAILED)
+        {
+            throw std::bad_alloc();
+        }
+
+        if (huge)
+        {
+            // trim the reservation down to a huge page aligned mapping
+            const auto address = reinterpret_cast<std::uintptr_t>(data);
+            const auto aligned = (address + huge_page_size - 1) / huge_page_size * huge_page_size;
+            const auto head = aligned - address;
+
+            if (head != 0)
+            {
+                munmap(data, head);
+            }
+
+            if (const auto tail = reserve_size - head - mapping_size; tail != 0)
+            {
+                munmap(data + head + mapping_size, tail);
+            }
+
+            data += head;
+            madvise(data, mapping_size, MADV_HUGEPAGE);
+        }
+
+        if (!topology_.fake && placement_ != chunk_placement::first_touch && validate_id(node) && node < 64)
+        {
+            constexpr int mpol_preferred = 1;
+            const unsigned long mask = 1ul << node;
+            syscall(SYS_mbind, data, mapping_size, mpol_preferred, &mask, sizeof(mask) * 8, 0);
+        }
+
+        return data;
+    }
+
+    inline std::byte* numa_chunk_allocator::allocate_slab_chunk(const size_type bytes, const size_type node)
+    {
+        std::lock_guard lock(slab_mutex_);
+
+        for (auto& current : slab_list_)
+        {
+            if (current.node != node || current.bytes != bytes)
+            {
+                continue;
+            }
+
+            if (!current.free_list.empty())
+            {
+                const auto data = current.free_list.back();
+                current.free_list.pop_back();
+                return data;
+            }
+
+            if (current.used + bytes <= huge_page_size)
+            {
+                const auto data = current.data + current.used;
+                current.used += bytes;
+                return data;
+            }
+        }
+
+        slab_list_.push_back({map(huge_page_size, true, node), node, bytes, bytes, {}});
+        return slab_list_.back().data;
+    }
+
+    inline void numa_chunk_allocator::deallocate_slab_chunk(std::byte* data)
+    {
+        std::lock_guard lock(slab_mutex_);
+
+        const auto address = reinterpret_cast<std::uintptr_t>(data);
+        const auto base = reinterpret_cast<std::byte*>(address / huge_page_size * huge_page_size);
+        const auto it = std::ranges::find(slab_list_, base, &slab::data);
+        it->free_list.push_back(data);
+    }
+#endif
+} // namespace nyx::ecs::detail
@@ -5,10 +5,15 @@
 
 #pragma once
 
+#include <limits>
 #include <source_location>
 #include <string>
 #include <string_view>
 
+#if defined _MSC_VER && !defined __clang__
+#include <xmmintrin.h>
+#endif
+
 namespace nyx::ecs::detail
 {
     using size_type = size_t;
@@ -16,9 +21,20 @@ namespace nyx::ecs::detail
     using string = std::string;
     using string_view = std::string_view;
     using source_location = std::source_location;
+    using entity = id_type;
 
     inline constexpr size_type chunk_capacity = 1024;
+    inline constexpr size_type chunk_alignment = 64;
     inline constexpr size_type invalid_id = std::numeric_limits<size_type>::max();
 
     constexpr bool validate_id(size_type value) { return value != invalid_id; }
+
+    inline void prefetch(const void* address)
+    {
+#if defined __clang__ || defined __GNUC__
+        __builtin_prefetch(address);
+#elif defined _MSC_VER
+        _mm_prefetch(static_cast<const char*>(address), _MM_HINT_T0);
+#endif
+    }
 } // namespace nyx::ecs::detail
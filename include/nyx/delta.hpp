@@ -0,0 +1,565 @@
+//
+// Created by loki7 on 25-7-14.
+//
+
+
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <tuple>
+#include <vector>
+
+#include <nyx/common.h>
+#include <nyx/snapshot.hpp>
+
+namespace nyx::ecs::detail
+{
+    // the difference between two snapshots as one flat byte stream, cheap to fan out or keep in a rollback buffer.
+    //
+    // per changed chunk it stores a bitmap of the rows that differ, the entity of every changed row, and for every
+    // column the changed rows xor-ed against the base frame, with zero runs collapsed:
+    //
+    //   header : frame, type count, { name, element size } per type, removed page count, { table, chunk } per page
+    //   page   : table, chunk, size, bitmap words, entity per changed row,
+    //            { has column, encoded size, encoded bytes } per type
+    //   encoded: { zero run, literal length, literal bytes } until the changed rows are covered
+    class snapshot_delta
+    {
+    public:
+        // from may be nullptr, the delta then carries the whole of to.
+        static snapshot_delta encode(const snapshot* from, const snapshot& to);
+        static snapshot_delta create(std::span<const std::byte> data);
+
+        // rebuilds the snapshot encode() was given as to; pages without changes are shared with from.
+        // returns nullptr when from does not hold the same component types as the delta, or the stream is malformed.
+        [[nodiscard]] std::shared_ptr<const snapshot> apply(const snapshot* from) const;
+
+        [[nodiscard]] std::span<const std::byte> data() const;
+        [[nodiscard]] size_type size() const;
+
+    private:
+        // page coordinates past this are treated as corrupt instead of being allocated for.
+        static constexpr size_type max_page_index = size_type{1} << 20;
+
+        std::vector<std::byte> data_{};
+
+        // every read is bounds checked, a read past the end sets failed and yields nothing from then on.
+        struct reader
+        {
+            std::span<const std::byte> data;
+            size_type offset{0};
+            bool failed{false};
+
+            size_type read();
+            std::span<const std::byte> read_bytes(size_type count);
+        };
+
+        void write(size_type value);
+        void write_bytes(const std::byte* data, size_type count);
+        void write_xor(const std::vector<std::byte>& xor_data);
+
+        static bool read_xor(reader& stream, std::byte* target, size_type count);
+    };
+
+
+    inline snapshot_delta snapshot_delta::encode(const snapshot* from, const snapshot& to)
+    {
+        snapshot_delta result;
+        const auto type_count = to.type_name_list_.size();
+
+        result.write(to.frame_);
+        result.write(type_count);
+
+        for (size_type i = 0; i < type_count; i++)
+        {
+            const auto& name = to.type_name_list_[i];
+            result.write(name.size());
+            result.write_bytes(reinterpret_cast<const std::byte*>(name.data()), name.size());
+            result.write(to.element_size_list_[i]);
+        }
+
+        if (from != nullptr && from->type_name_list_ != to.type_name_list_)
+        {
+            from = nullptr;
+        }
+
+        std::vector<const snapshot::page*> removed_list;
+
+        if (from != nullptr)
+        {
+            for (const auto& old : from->page_list_)
+            {
+                if (to.find_page(old.table_index, old.chunk) == nullptr)
+                {
+                    removed_list.push_back(&old);
+                }
+            }
+        }
+
+        result.write(removed_list.size());
+
+        for (const auto old : removed_list)
+        {
+            result.write(old->table_index);
+            result.write(old->chunk);
+        }
+
+        std::vector<std::uint64_t> bitmap;
+        std::vector<std::byte> xor_data;
+
+        for (const auto& current : to.page_list_)
+        {
+            const auto old = from != nullptr ? from->find_page(current.table_index, current.chunk) : nullptr;
+            const auto old_size = old != nullptr ? old->size : 0;
+            const auto same_entities = old != nullptr && old->entity_list == current.entity_list;
+            std::vector<entity> changed_entity_list;
+
+            bitmap.assign((current.size + 63) / 64, 0);
+
+            for (size_type row = 0; row < current.size; row++)
+            {
+                auto changed = row >= old_size ||
+                               (!same_entities && (*old->entity_list)[row] != (*current.entity_list)[row]);
+
+                for (size_type i = 0; i < type_count && !changed; i++)
+                {
+                    const auto& column = current.column_list[i];
+                    const auto& old_column = old->column_list[i];
+                    const auto element_size = to.element_size_list_[i];
+
+                    if (column == old_column)
+                    {
+                        continue;
+                    }
+
+                    changed = column == nullptr || old_column == nullptr ||
+                              std::memcmp(column->data() + row * element_size, old_column->data() + row * element_size,
+                                          element_size) != 0;
+                }
+
+                if (changed)
+                {
+                    bitmap[row / 64] |= std::uint64_t{1} << (row % 64);
+                    changed_entity_list.push_back((*current.entity_list)[row]);
+                }
+            }
+
+            if (changed_entity_list.empty() && old_size == current.size)
+            {
+                continue;
+            }
+
+            result.write(current.table_index);
+            result.write(current.chunk);
+            result.write(current.size);
+
+            for (const auto word : bitmap)
+            {
+                result.write(word);
+            }
+
+            for (const auto value : changed_entity_list)
+            {
+                result.write(value);
+            }
+
+            for (size_type i = 0; i < type_count; i++)
+            {
+                const auto& column = current.column_list[i];
+                const auto old_column = old != nullptr ? old->column_list[i] : nullptr;
+                const auto element_size = to.element_size_list_[i];
+
+                xor_data.clear();
+
+                if (column != nullptr)
+                {
+                    for (size_type row = 0; row < current.size; row++)
+                    {
+                        if ((bitmap[row / 64] >> (row % 64) & 1) == 0)
+                        {
+                            continue;
+                        }
+
+                        for (size_type byte = 0; byte < element_size; byte++)
+                        {
+                            const auto offset = row * element_size + byte;
+                            const auto base = old_column != nullptr && row < old_size ? (*old_column)[offset]
+                                                                                       : std::byte{0};
+                            xor_data.push_back((*column)[offset] ^ base);
+                        }
+                    }
+                }
+
+                result.write(column != nullptr ? 1 : 0);
+                result.write_xor(xor_data);
+            }
+        }
+
+        return result;
+    }
+
+    inline snapshot_delta snapshot_delta::create(const std::span<const std::byte> data)
+    {
+        snapshot_delta result;
+        result.data_.assign(data.begin(), data.end());
+        return result;
+    }
+
+    inline std::shared_ptr<const snapshot> snapshot_delta::apply(const snapshot* from) const
+    {
+        reader stream{data_};
+        auto result = std::make_shared<snapshot>();
+
+        result->frame_ = stream.read();
+        const auto type_count = stream.read();
+
+        for (size_type i = 0; i < type_count && !stream.failed; i++)
+        {
+            const auto name = stream.read_bytes(stream.read());
+            result->type_name_list_.emplace_back(reinterpret_cast<const char*>(name.data()), name.size());
+            result->element_size_list_.push_back(stream.read());
+
+            if (result->element_size_list_.back() > snapshot::max_element_size)
+            {
+                return nullptr;
+            }
+        }
+
+        if (stream.failed || (from != nullptr && (from->type_name_list_ != result->type_name_list_ ||
+                                                  from->element_size_list_ != result->element_size_list_)))
+        {
+            return nullptr;
+        }
+
+        std::vector<std::vector<bool>> keep_list;
+
+        if (from != nullptr)
+        {
+            for (const auto& old : from->page_index_list_)
+            {
+                keep_list.emplace_back(old.size(), true);
+            }
+        }
+
+        for (auto removed_count = stream.read(); removed_count > 0 && !stream.failed; removed_count--)
+        {
+            const auto table_index = stream.read();
+            const auto chunk = stream.read();
+
+            if (table_index < keep_list.size() && chunk < keep_list[table_index].size())
+            {
+                keep_list[table_index][chunk] = false;
+            }
+        }
+
+        if (stream.failed)
+        {
+            return nullptr;
+        }
+
+        std::vector<snapshot::page> changed_list;
+
+        while (stream.offset < stream.data.size())
+        {
+            snapshot::page current{.table_index = stream.read(), .chunk = stream.read(), .size = stream.read()};
+            current.entity_version = invalid_id;
+            current.version_list.assign(type_count, invalid_id);
+
+            if (stream.failed || current.table_index >= max_page_index || current.chunk >= max_page_index ||
+                current.size > chunk_capacity)
+            {
+                return nullptr;
+            }
+
+            const auto old = from != nullptr ? from->find_page(current.table_index, current.chunk) : nullptr;
+            const auto old_size = old != nullptr ? old->size : 0;
+
+            std::vector<std::uint64_t> bitmap((current.size + 63) / 64);
+
+            size_type changed_count = 0;
+
+            for (auto& word : bitmap)
+            {
+                word = stream.read();
+                changed_count += static_cast<size_type>(std::popcount(word));
+            }
+
+            // rows past the end of the chunk can not have changed
+            if (current.size % 64 != 0 && bitmap.back() >> (current.size % 64) != 0)
+            {
+                return nullptr;
+            }
+
+            auto entity_list = std::make_shared<std::vector<entity>>(current.size);
+
+            if (old != nullptr)
+            {
+                std::copy_n(old->entity_list->begin(), std::min(old_size, current.size), entity_list->begin());
+            }
+
+            for (size_type row = 0; row < current.size; row++)
+            {
+                if ((bitmap[row / 64] >> (row % 64) & 1) != 0)
+                {
+                    (*entity_list)[row] = stream.read();
+                }
+            }
+
+            if (stream.failed)
+            {
+                return nullptr;
+            }
+
+            current.entity_list = std::move(entity_list);
+
+            for (size_type i = 0; i < type_count; i++)
+            {
+                const auto element_size = result->element_size_list_[i];
+                const auto has_column = stream.read() != 0;
+                const auto xor_size = stream.read();
+                const auto old_column = old != nullptr ? old->column_list[i] : nullptr;
+
+                if (stream.failed)
+                {
+                    return nullptr;
+                }
+
+                if (!has_column)
+                {
+                    if (xor_size != 0)
+                    {
+                        return nullptr;
+                    }
+
+                    current.column_list.emplace_back();
+                    continue;
+                }
+
+                if (xor_size != changed_count * element_size)
+                {
+                    return nullptr;
+                }
+
+                auto column = std::make_shared<std::vector<std::byte>>(current.size * element_size);
+
+                if (old_column != nullptr)
+                {
+                    std::memcpy(column->data(), old_column->data(), std::min(old_size, current.size) * element_size);
+                }
+
+                std::vector<std::byte> xor_data(xor_size);
+
+                if (!read_xor(stream, xor_data.data(), xor_size))
+                {
+                    return nullptr;
+                }
+
+                size_type cursor = 0;
+
+                for (size_type row = 0; row < current.size; row++)
+                {
+                    if ((bitmap[row / 64] >> (row % 64) & 1) == 0)
+                    {
+                        continue;
+                    }
+
+                    const auto target = column->data() + row * element_size;
+
+                    if (old_column == nullptr || row >= old_size)
+                    {
+                        std::memset(target, 0, element_size);
+                    }
+
+                    for (size_type byte = 0; byte < element_size; byte++)
+                    {
+                        target[byte] ^= xor_data[cursor++];
+                    }
+                }
+
+                current.column_list.push_back(std::move(column));
+            }
+
+            if (current.table_index < keep_list.size() && current.chunk < keep_list[current.table_index].size())
+            {
+                keep_list[current.table_index][current.chunk] = false;
+            }
+
+            changed_list.push_back(std::move(current));
+        }
+
+        if (from != nullptr)
+        {
+            for (const auto& old : from->page_list_)
+            {
+                if (keep_list[old.table_index][old.chunk])
+                {
+                    changed_list.push_back(old);
+                }
+            }
+        }
+
+        // keep the (table, chunk) order take_snapshot produces
+        std::ranges::sort(changed_list, [](const snapshot::page& lhs, const snapshot::page& rhs)
+                          { return std::tie(lhs.table_index, lhs.chunk) < std::tie(rhs.table_index, rhs.chunk); });
+
+        if (std::ranges::adjacent_find(changed_list, [](const snapshot::page& lhs, const snapshot::page& rhs)
+                                       { return lhs.table_index == rhs.table_index && lhs.chunk == rhs.chunk; }) !=
+            changed_list.end())
+        {
+            return nullptr;
+        }
+
+        for (auto& current : changed_list)
+        {
+            if (result->page_index_list_.size() <= current.table_index)
+            {
+                result->page_index_list_.resize(current.table_index + 1);
+            }
+
+            auto& page_index_list = result->page_index_list_[current.table_index];
+
+            if (page_index_list.size() <= current.chunk)
+            {
+                page_index_list.resize(current.chunk + 1, invalid_id);
+            }
+
+            page_index_list[current.chunk] = result->page_list_.size();
+            result->size_ += current.size;
+            result->page_list_.push_back(std::move(current));
+        }
+
+        return result;
+    }
+
+    inline std::span<const std::byte> snapshot_delta::data() const { return data_; }
+
+    inline size_type snapshot_delta::size() const { return data_.size(); }
+
+    inline void snapshot_delta::write(size_type value)
+    {
+        while (value >= 0x80)
+        {
+            data_.push_back(static_cast<std::byte>(value | 0x80));
+            value >>= 7;
+        }
+
+        data_.push_back(static_cast<std::byte>(value));
+    }
+
+    inline void snapshot_delta::write_bytes(const std::byte* data, const size_type count)
+    {
+        data_.insert(data_.end(), data, data + count);
+    }
+
+    inline void snapshot_delta::write_xor(const std::vector<std::byte>& xor_data)
+    {
+        constexpr size_type min_zero_run = 4;
+
+        write(xor_data.size());
+
+        for (size_type begin = 0; begin < xor_data.size();)
+        {
+            auto literal = begin;
+
+            while (literal < xor_data.size() && xor_data[literal] == std::byte{0})
+            {
+                literal++;
+            }
+
+            // a literal ends once a zero run long enough to be worth its own header starts
+            auto end = literal;
+
+            for (size_type zero_run = 0; end < xor_data.size(); end++)
+            {
+                zero_run = xor_data[end] == std::byte{0} ? zero_run + 1 : 0;
+
+                if (zero_run == min_zero_run)
+                {
+                    end -= min_zero_run - 1;
+                    break;
+                }
+            }
+
+            write(literal - begin);
+            write(end - literal);
+            write_bytes(xor_data.data() + literal, end - literal);
+            begin = end;
+        }
+    }
+
+    // false when the stream ends early or a run reaches past count.
+    inline bool snapshot_delta::read_xor(reader& stream, std::byte* target, const size_type count)
+    {
+        for (size_type cursor = 0; cursor < count;)
+        {
+            const auto zero_run = stream.read();
+
+            if (stream.failed || zero_run > count - cursor)
+            {
+                return false;
+            }
+
+            std::memset(target + cursor, 0, zero_run);
+            cursor += zero_run;
+
+            const auto literal_size = stream.read();
+
+            if (stream.failed || literal_size > count - cursor)
+            {
+                return false;
+            }
+
+            const auto literal = stream.read_bytes(literal_size);
+
+            if (stream.failed || (zero_run == 0 && literal_size == 0))
+            {
+                return false;
+            }
+
+            std::memcpy(target + cursor, literal.data(), literal.size());
+            cursor += literal.size();
+        }
+
+        return true;
+    }
+
+    inline size_type snapshot_delta::reader::read()
+    {
+        size_type value = 0;
+
+        for (size_type shift = 0;; shift += 7)
+        {
+            if (failed || offset >= data.size() || shift >= 64)
+            {
+                failed = true;
+                return 0;
+            }
+
+            const auto byte = static_cast<size_type>(data[offset++]);
+            value |= (byte & 0x7f) << shift;
+
+            if ((byte & 0x80) == 0)
+            {
+                return value;
+            }
+        }
+    }
+
+    inline std::span<const std::byte> snapshot_delta::reader::read_bytes(const size_type count)
+    {
+        if (failed || count > data.size() - offset)
+        {
+            failed = true;
+            return {};
+        }
+
+        const auto bytes = data.subspan(offset, count);
+        offset += count;
+        return bytes;
+    }
+} // namespace nyx::ecs::detail
@@ -41,6 +41,7 @@ namespace nyx::ecs::detail
         bool has_key(const find_key_type& key);
         void remove(const find_key_type& key);
         value_type* get(const find_key_type& key);
+        void clear();
 
     private:
         size_type size_{0};
@@ -165,7 +166,8 @@ namespace nyx::ecs::detail
 
             size_--;
 
-            if (size_ == 0)
+            // the removed entry was the last one, nothing has to be moved into its slot
+            if (curr_index == size_)
             {
                 return;
             }
@@ -199,5 +201,13 @@ namespace nyx::ecs::detail
         return nullptr;
     }
 
+    template <typename KeyType, typename ValueType, size_type BucketCount>
+    void dense_map<KeyType, ValueType, BucketCount>::clear()
+    {
+        size_ = 0;
+        packed_.ensure_chunk_size(0);
+        sparse_.ensure_chunk_size(0);
+    }
+
 
 } // namespace nyx::ecs::detail
@@ -0,0 +1,167 @@
+//
+// Created by loki7 on 25-7-20.
+//
+
+
+#pragma once
+
+#include <algorithm>
+#include <span>
+#include <vector>
+
+#include <nyx/common.h>
+#include <nyx/registry.hpp>
+#include <nyx/table.hpp>
+#include <nyx/type_info.hpp>
+
+namespace nyx::ecs::detail
+{
+    struct dynamic_term
+    {
+        size_type index;
+        bool read_only{false};
+    };
+
+
+    // one component column of one chunk. field_list is the offset table of the component's fields,
+    // the bytes of row i start at data + stride * i.
+    struct dynamic_column
+    {
+        std::byte* data;
+        // 0 for shared columns: every row reads the chunk's single value.
+        size_type stride;
+        std::span<const type_field> field_list;
+
+        [[nodiscard]] std::byte* get(size_type row) const;
+    };
+
+
+    // the runtime counterpart of static_query for components addressed by type index, typically registered through
+    // registry::register_type. a whole chunk is handed out per call so script bindings cross the boundary once per
+    // chunk instead of once per entity. shared components must be read_only terms, the query is invalid otherwise.
+    class dynamic_query
+    {
+    public:
+        dynamic_query(registry& owner, std::vector<dynamic_term> term_list);
+
+        // func(std::span<entity>, std::span<const dynamic_column>) once per chunk, columns follow the term order.
+        // columns of terms that are not read_only are marked as written.
+        template <typename Func>
+        void each_chunk(Func&& func);
+
+        [[nodiscard]] bool valid() const;
+        [[nodiscard]] size_type table_count() const;
+
+    private:
+        struct binding
+        {
+            table* owner;
+            std::vector<size_type> slot_list;
+        };
+
+        registry* registry_;
+        std::vector<dynamic_term> term_list_;
+        std::vector<const type_info*> type_info_list_{};
+        std::vector<size_type> sorted_type_index_list_{};
+        std::vector<binding> binding_list_{};
+        std::vector<dynamic_column> column_list_{};
+        size_type scanned_size_{0};
+        bool valid_{true};
+
+        void refresh();
+    };
+
+
+    inline std::byte* dynamic_column::get(const size_type row) const { return data + stride * row; }
+
+
+    inline dynamic_query::dynamic_query(registry& owner, std::vector<dynamic_term> term_list) :
+        registry_(&owner), term_list_(std::move(term_list))
+    {
+        // shared columns are the chunk's key, writing them in place would bypass the re-keying emplace does
+        for (const auto& term : term_list_)
+        {
+            const auto info = owner.get_type_info(term.index);
+            valid_ = valid_ && info != nullptr && (!info->shared || term.read_only);
+            type_info_list_.push_back(info);
+            sorted_type_index_list_.push_back(term.index);
+        }
+
+        std::ranges::sort(sorted_type_index_list_);
+        valid_ = valid_ && std::ranges::adjacent_find(sorted_type_index_list_) == sorted_type_index_list_.end();
+        column_list_.resize(term_list_.size());
+    }
+
+    template <typename Func>
+    void dynamic_query::each_chunk(Func&& func)
+    {
+        if (!valid_)
+        {
+            return;
+        }
+
+        refresh();
+
+        for (const auto& [owner, slot_list] : binding_list_)
+        {
+            if (owner->size == 0)
+            {
+                continue;
+            }
+
+            for (size_type chunk = 0; chunk < owner->chunk_list.size(); chunk++)
+            {
+                const auto count = owner->chunk_list[chunk].size;
+
+                if (count == 0)
+                {
+                    continue;
+                }
+
+                for (size_type i = 0; i < term_list_.size(); i++)
+                {
+                    const auto slot = slot_list[i];
+                    const auto& column = owner->column_list[slot];
+
+                    if (!term_list_[i].read_only && !column.shared)
+                    {
+                        owner->touch(slot, chunk);
+                    }
+
+                    column_list_[i] = {owner->column(slot, chunk), column.shared ? 0 : column.size,
+                                       type_info_list_[i]->field_list};
+                }
+
+                func(std::span(owner->entities(chunk), count), std::span<const dynamic_column>(column_list_));
+            }
+        }
+    }
+
+    inline bool dynamic_query::valid() const { return valid_; }
+
+    inline size_type dynamic_query::table_count() const { return binding_list_.size(); }
+
+    inline void dynamic_query::refresh()
+    {
+        const auto& table_list = registry_->table_list_;
+
+        for (; scanned_size_ < table_list.size(); scanned_size_++)
+        {
+            const auto owner = table_list[scanned_size_].get();
+
+            if (!owner->has_columns(sorted_type_index_list_))
+            {
+                continue;
+            }
+
+            binding current{.owner = owner};
+
+            for (const auto& term : term_list_)
+            {
+                current.slot_list.push_back(owner->find_column(term.index));
+            }
+
+            binding_list_.push_back(std::move(current));
+        }
+    }
+} // namespace nyx::ecs::detail
@@ -6,14 +6,42 @@
 #pragma once
 
 
+#include <nyx/chunk_allocator.hpp>
 #include <nyx/common.h>
+#include <nyx/delta.hpp>
+#include <nyx/dynamic_query.hpp>
 #include <nyx/flex_array.hpp>
+#include <nyx/hierarchy.hpp>
+#include <nyx/observer.hpp>
 #include <nyx/registry.hpp>
+#include <nyx/snapshot.hpp>
+#include <nyx/static_query.hpp>
 #include <nyx/type_info.hpp>
 #include <nyx/type_utility.hpp>
+#include <nyx/worker_pool.hpp>
 
 
 namespace nyx::ecs
 {
+    using entity = detail::entity;
     using registry = detail::registry;
+    using numa_topology = detail::numa_topology;
+    using chunk_allocator = detail::chunk_allocator;
+    using chunk_placement = detail::chunk_placement;
+    using numa_chunk_allocator = detail::numa_chunk_allocator;
+    using worker_pool = detail::worker_pool;
+    using observer_event = detail::observer_event;
+    using snapshot = detail::snapshot;
+    using snapshot_buffer = detail::snapshot_buffer;
+    using snapshot_delta = detail::snapshot_delta;
+    using type_field = detail::type_field;
+    using dynamic_term = detail::dynamic_term;
+    using dynamic_column = detail::dynamic_column;
+    using dynamic_query = detail::dynamic_query;
+
+    template <typename T>
+    using hierarchy = detail::hierarchy<T>;
+
+    template <typename... Ts>
+    using static_query = detail::static_query<Ts...>;
 }
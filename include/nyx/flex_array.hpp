@@ -15,6 +15,8 @@ namespace nyx::ecs::detail
     template <typename T, size_type ChunkSize = 1024>
     struct flex_array
     {
+        static constexpr size_type chunk_size = ChunkSize;
+
         flex_array();
 
         template <typename... Args>
@@ -65,7 +67,11 @@ namespace nyx::ecs::detail
         const auto chunk_index = index / ChunkSize;
         const auto target_chunk_size = chunk_index + 1;
 
-        ensure_chunk_size(target_chunk_size);
+        if (chunks_.size() < target_chunk_size)
+        {
+            ensure_chunk_size(target_chunk_size);
+        }
+
         return size_;
     }
 
@@ -0,0 +1,445 @@
+//
+// Created by loki7 on 25-7-10.
+//
+
+
+#pragma once
+
+#include <algorithm>
+#include <numeric>
+#include <span>
+#include <vector>
+
+#include <nyx/common.h>
+#include <nyx/sparse_set.hpp>
+#include <nyx/worker_pool.hpp>
+
+namespace nyx::ecs::detail
+{
+    // parent/child relationships stored depth by depth: every level keeps its entities, the index of their parent
+    // in the level above, and the local and world values side by side, so propagate() walks parents before children
+    // over contiguous arrays. the per-entity links are only touched when the shape of the hierarchy changes.
+    template <typename T>
+    class hierarchy
+    {
+    public:
+        // returns false when value is already part of the hierarchy, use reparent and get_local to move or update it,
+        // or when parent is neither invalid_id nor part of the hierarchy.
+        bool insert(entity value, const T& local, entity parent = invalid_id);
+        // removes value together with its whole subtree.
+        void remove(entity value);
+        // moves value and its subtree under parent, invalid_id turns it into a root. returns false on cycles.
+        bool reparent(entity value, entity parent);
+
+        bool contains(entity value);
+        entity get_parent(entity value);
+        size_type get_depth(entity value);
+        T* get_local(entity value);
+        const T* get_world(entity value);
+
+        [[nodiscard]] size_type level_count() const;
+        [[nodiscard]] std::span<const entity> get_level(size_type depth) const;
+
+        // world = local for roots, world = combine(parent world, local) for everything below.
+        template <typename Func>
+        void propagate(Func&& combine);
+
+        // same as propagate, every level is split into batches that run on pool before the next level starts.
+        template <typename Func>
+        void propagate(worker_pool& pool, Func&& combine, size_type batch_size = 4096);
+
+        // reorders every level by parent index so siblings are adjacent and parent reads stay sequential.
+        void optimize();
+
+    private:
+        struct node_record
+        {
+            size_type depth;
+            size_type index;
+            entity parent;
+            entity first_child;
+            entity next_sibling;
+            entity prev_sibling;
+        };
+
+        struct level
+        {
+            std::vector<entity> entity_list{};
+            std::vector<size_type> parent_list{};
+            std::vector<T> local_list{};
+            std::vector<T> world_list{};
+        };
+
+        sparse_set<node_record> record_set_{};
+        std::vector<level> level_list_{};
+
+        std::vector<entity> collect_subtree(entity value);
+        void link(entity value, entity parent);
+        void unlink(entity value);
+        void attach(entity value, const T& local, const T& world);
+        void detach(entity value, T& local, T& world);
+        void propagate_range(size_type depth, size_type begin, size_type end, auto& combine);
+    };
+
+
+    template <typename T>
+    bool hierarchy<T>::insert(const entity value, const T& local, const entity parent)
+    {
+        const auto parent_record = validate_id(parent) ? record_set_.get(parent) : nullptr;
+
+        if (contains(value) || (validate_id(parent) && parent_record == nullptr))
+        {
+            return false;
+        }
+
+        record_set_.set(value, {parent_record != nullptr ? parent_record->depth + 1 : 0, invalid_id, invalid_id,
+                                invalid_id, invalid_id, invalid_id});
+        link(value, parent);
+        attach(value, local, local);
+
+        return true;
+    }
+
+    template <typename T>
+    void hierarchy<T>::remove(const entity value)
+    {
+        if (!contains(value))
+        {
+            return;
+        }
+
+        const auto subtree = collect_subtree(value);
+        unlink(value);
+
+        T local{};
+        T world{};
+
+        for (const auto node : subtree)
+        {
+            detach(node, local, world);
+        }
+
+        for (const auto node : subtree)
+        {
+            record_set_.remove(node);
+        }
+    }
+
+    template <typename T>
+    bool hierarchy<T>::reparent(const entity value, const entity parent)
+    {
+        if (!contains(value) || (validate_id(parent) && !contains(parent)))
+        {
+            return false;
+        }
+
+        for (auto ancestor = parent; validate_id(ancestor); ancestor = record_set_.get(ancestor)->parent)
+        {
+            if (ancestor == value)
+            {
+                return false;
+            }
+        }
+
+        const auto subtree = collect_subtree(value);
+        std::vector<T> local_list(subtree.size());
+        std::vector<T> world_list(subtree.size());
+
+        // breadth first: a node always leaves and re-enters the levels before its children do
+        for (size_type i = 0; i < subtree.size(); i++)
+        {
+            detach(subtree[i], local_list[i], world_list[i]);
+        }
+
+        unlink(value);
+        link(value, parent);
+
+        for (size_type i = 0; i < subtree.size(); i++)
+        {
+            const auto record = record_set_.get(subtree[i]);
+            record->depth = validate_id(record->parent) ? record_set_.get(record->parent)->depth + 1 : 0;
+            attach(subtree[i], local_list[i], world_list[i]);
+        }
+
+        return true;
+    }
+
+    template <typename T>
+    bool hierarchy<T>::contains(const entity value)
+    {
+        return record_set_.get(value) != nullptr;
+    }
+
+    template <typename T>
+    entity hierarchy<T>::get_parent(const entity value)
+    {
+        const auto record = record_set_.get(value);
+        return record != nullptr ? record->parent : invalid_id;
+    }
+
+    template <typename T>
+    size_type hierarchy<T>::get_depth(const entity value)
+    {
+        const auto record = record_set_.get(value);
+        return record != nullptr ? record->depth : invalid_id;
+    }
+
+    template <typename T>
+    T* hierarchy<T>::get_local(const entity value)
+    {
+        const auto record = record_set_.get(value);
+        return record != nullptr ? &level_list_[record->depth].local_list[record->index] : nullptr;
+    }
+
+    template <typename T>
+    const T* hierarchy<T>::get_world(const entity value)
+    {
+        const auto record = record_set_.get(value);
+        return record != nullptr ? &level_list_[record->depth].world_list[record->index] : nullptr;
+    }
+
+    template <typename T>
+    size_type hierarchy<T>::level_count() const
+    {
+        return level_list_.size();
+    }
+
+    template <typename T>
+    std::span<const entity> hierarchy<T>::get_level(const size_type depth) const
+    {
+        return level_list_[depth].entity_list;
+    }
+
+    template <typename T>
+    template <typename Func>
+    void hierarchy<T>::propagate(Func&& combine)
+    {
+        for (size_type depth = 0; depth < level_list_.size(); depth++)
+        {
+            propagate_range(depth, 0, level_list_[depth].entity_list.size(), combine);
+        }
+    }
+
+    template <typename T>
+    template <typename Func>
+    void hierarchy<T>::propagate(worker_pool& pool, Func&& combine, const size_type batch_size)
+    {
+        for (size_type depth = 0; depth < level_list_.size(); depth++)
+        {
+            const auto size = level_list_[depth].entity_list.size();
+            const auto batch_count = (size + batch_size - 1) / batch_size;
+
+            if (batch_count <= 1)
+            {
+                propagate_range(depth, 0, size, combine);
+                continue;
+            }
+
+            pool.run(std::vector(batch_count, invalid_id),
+                     [&](const size_type batch, size_type)
+                     {
+                         const auto begin = batch * batch_size;
+                         propagate_range(depth, begin, std::min(size, begin + batch_size), combine);
+                     });
+        }
+    }
+
+    template <typename T>
+    void hierarchy<T>::optimize()
+    {
+        std::vector<size_type> remap_list;
+
+        for (size_type depth = 0; depth < level_list_.size(); depth++)
+        {
+            auto& current = level_list_[depth];
+            const auto size = current.entity_list.size();
+
+            if (depth != 0)
+            {
+                for (auto& parent : current.parent_list)
+                {
+                    parent = remap_list[parent];
+                }
+            }
+
+            std::vector<size_type> order(size);
+            std::iota(order.begin(), order.end(), 0);
+
+            if (depth != 0)
+            {
+                std::stable_sort(order.begin(), order.end(), [&](const size_type lhs, const size_type rhs)
+                                 { return current.parent_list[lhs] < current.parent_list[rhs]; });
+            }
+
+            level next;
+            next.entity_list.reserve(size);
+            next.parent_list.reserve(size);
+            next.local_list.reserve(size);
+            next.world_list.reserve(size);
+            remap_list.assign(size, invalid_id);
+
+            for (size_type i = 0; i < size; i++)
+            {
+                const auto from = order[i];
+                next.entity_list.push_back(current.entity_list[from]);
+                next.parent_list.push_back(current.parent_list[from]);
+                next.local_list.push_back(current.local_list[from]);
+                next.world_list.push_back(current.world_list[from]);
+                record_set_.get(current.entity_list[from])->index = i;
+                remap_list[from] = i;
+            }
+
+            current = std::move(next);
+        }
+    }
+
+    template <typename T>
+    std::vector<entity> hierarchy<T>::collect_subtree(const entity value)
+    {
+        std::vector<entity> subtree{value};
+
+        for (size_type i = 0; i < subtree.size(); i++)
+        {
+            for (auto child = record_set_.get(subtree[i])->first_child; validate_id(child);
+                 child = record_set_.get(child)->next_sibling)
+            {
+                subtree.push_back(child);
+            }
+        }
+
+        return subtree;
+    }
+
+    template <typename T>
+    void hierarchy<T>::link(const entity value, const entity parent)
+    {
+        const auto record = record_set_.get(value);
+        record->parent = parent;
+        record->prev_sibling = invalid_id;
+        record->next_sibling = invalid_id;
+
+        if (!validate_id(parent))
+        {
+            return;
+        }
+
+        const auto parent_record = record_set_.get(parent);
+        record->next_sibling = parent_record->first_child;
+
+        if (validate_id(parent_record->first_child))
+        {
+            record_set_.get(parent_record->first_child)->prev_sibling = value;
+        }
+
+        parent_record->first_child = value;
+    }
+
+    template <typename T>
+    void hierarchy<T>::unlink(const entity value)
+    {
+        const auto record = record_set_.get(value);
+
+        if (validate_id(record->prev_sibling))
+        {
+            record_set_.get(record->prev_sibling)->next_sibling = record->next_sibling;
+        }
+        else if (validate_id(record->parent))
+        {
+            record_set_.get(record->parent)->first_child = record->next_sibling;
+        }
+
+        if (validate_id(record->next_sibling))
+        {
+            record_set_.get(record->next_sibling)->prev_sibling = record->prev_sibling;
+        }
+
+        record->parent = invalid_id;
+        record->prev_sibling = invalid_id;
+        record->next_sibling = invalid_id;
+    }
+
+    template <typename T>
+    void hierarchy<T>::attach(const entity value, const T& local, const T& world)
+    {
+        const auto record = record_set_.get(value);
+
+        if (level_list_.size() <= record->depth)
+        {
+            level_list_.resize(record->depth + 1);
+        }
+
+        auto& target = level_list_[record->depth];
+        record->index = target.entity_list.size();
+        target.entity_list.push_back(value);
+        target.parent_list.push_back(validate_id(record->parent) ? record_set_.get(record->parent)->index
+                                                                 : invalid_id);
+        target.local_list.push_back(local);
+        target.world_list.push_back(world);
+    }
+
+    // swap-removes value from its level; the children of the node moved into the hole get their parent index fixed.
+    template <typename T>
+    void hierarchy<T>::detach(const entity value, T& local, T& world)
+    {
+        const auto record = record_set_.get(value);
+        auto& target = level_list_[record->depth];
+        const auto index = record->index;
+        const auto tail = target.entity_list.size() - 1;
+
+        local = target.local_list[index];
+        world = target.world_list[index];
+
+        if (index != tail)
+        {
+            const auto moved = target.entity_list[tail];
+            target.entity_list[index] = moved;
+            target.parent_list[index] = target.parent_list[tail];
+            target.local_list[index] = std::move(target.local_list[tail]);
+            target.world_list[index] = std::move(target.world_list[tail]);
+
+            const auto moved_record = record_set_.get(moved);
+            moved_record->index = index;
+
+            for (auto child = moved_record->first_child; validate_id(child);
+                 child = record_set_.get(child)->next_sibling)
+            {
+                if (const auto child_record = record_set_.get(child); validate_id(child_record->index))
+                {
+                    level_list_[child_record->depth].parent_list[child_record->index] = index;
+                }
+            }
+        }
+
+        target.entity_list.pop_back();
+        target.parent_list.pop_back();
+        target.local_list.pop_back();
+        target.world_list.pop_back();
+        record->index = invalid_id;
+
+        while (!level_list_.empty() && level_list_.back().entity_list.empty())
+        {
+            level_list_.pop_back();
+        }
+    }
+
+    template <typename T>
+    void hierarchy<T>::propagate_range(const size_type depth, const size_type begin, const size_type end,
+                                       auto& combine)
+    {
+        auto& current = level_list_[depth];
+
+        if (depth == 0)
+        {
+            std::copy(current.local_list.begin() + begin, current.local_list.begin() + end,
+                      current.world_list.begin() + begin);
+            return;
+        }
+
+        const auto& parent_world_list = level_list_[depth - 1].world_list;
+
+        for (auto i = begin; i < end; i++)
+        {
+            current.world_list[i] = combine(parent_world_list[current.parent_list[i]], current.local_list[i]);
+        }
+    }
+} // namespace nyx::ecs::detail
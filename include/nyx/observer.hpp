@@ -0,0 +1,227 @@
+//
+// Created by loki7 on 25-7-16.
+//
+
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <vector>
+
+#include <nyx/common.h>
+#include <nyx/sparse_set.hpp>
+
+namespace nyx::ecs::detail
+{
+    enum class observer_event : std::uint8_t
+    {
+        add,
+        remove,
+        change,
+    };
+
+    using observer_callback = std::function<void(std::span<const entity>)>;
+
+
+    // the observers of one component type and the entities recorded for them since the last flush, one list per
+    // event kind. flush() hands every kind to its callbacks as a single span, removes first, then adds, then changes.
+    // within one flush an entity added and removed again is dropped from both lists, and a removal drops its pending
+    // change, so a recycled entity id shows up as remove followed by add.
+    struct observer_list
+    {
+        struct entry
+        {
+            size_type id;
+            observer_event event;
+            observer_callback callback;
+        };
+
+        std::vector<entry> entry_list{};
+        std::array<std::vector<entity>, 3> entity_list{};
+        // position of a pending entity inside entity_list[add] and entity_list[change]
+        sparse_set<size_type> added_set{};
+        sparse_set<size_type> changed_set{};
+        std::uint8_t event_mask{0};
+
+        [[nodiscard]] bool observes(observer_event event) const;
+        void record(observer_event event, entity value);
+        void add(size_type id, observer_event event, observer_callback callback);
+        bool remove(size_type id);
+        void flush();
+        // drops every pending event.
+        void clear();
+
+    private:
+        void push(observer_event event, sparse_set<size_type>& position_set, entity value);
+        bool drop(observer_event event, sparse_set<size_type>& position_set, entity value);
+        std::vector<entity>& get_list(observer_event event);
+    };
+
+
+    inline bool observer_list::observes(const observer_event event) const
+    {
+        return (event_mask >> static_cast<std::uint8_t>(event) & 1) != 0;
+    }
+
+    inline void observer_list::record(const observer_event event, const entity value)
+    {
+        switch (event)
+        {
+            case observer_event::add:
+            {
+                // adds are tracked for remove observers too, an add cancelled within the flush is no removal
+                if (observes(observer_event::add) || observes(observer_event::remove))
+                {
+                    push(event, added_set, value);
+                }
+
+                break;
+            }
+            case observer_event::change:
+            {
+                if (observes(observer_event::change))
+                {
+                    push(event, changed_set, value);
+                }
+
+                break;
+            }
+            case observer_event::remove:
+            default:
+            {
+                drop(observer_event::change, changed_set, value);
+
+                if (!drop(observer_event::add, added_set, value) && observes(observer_event::remove))
+                {
+                    get_list(observer_event::remove).push_back(value);
+                }
+
+                break;
+            }
+        }
+    }
+
+    inline void observer_list::add(const size_type id, const observer_event event, observer_callback callback)
+    {
+        entry_list.push_back({id, event, std::move(callback)});
+        event_mask |= static_cast<std::uint8_t>(1 << static_cast<std::uint8_t>(event));
+    }
+
+    inline bool observer_list::remove(const size_type id)
+    {
+        if (std::erase_if(entry_list, [&](const entry& current) { return current.id == id; }) == 0)
+        {
+            return false;
+        }
+
+        event_mask = 0;
+
+        for (const auto& current : entry_list)
+        {
+            event_mask |= static_cast<std::uint8_t>(1 << static_cast<std::uint8_t>(current.event));
+        }
+
+        return true;
+    }
+
+    inline void observer_list::flush()
+    {
+        // callbacks may touch the registry again, whatever they cause is delivered by the next flush
+        std::array<std::vector<entity>, 3> batch_list;
+        batch_list.swap(entity_list);
+
+        for (const auto value : batch_list[static_cast<size_type>(observer_event::add)])
+        {
+            added_set.remove(value);
+        }
+
+        for (const auto value : batch_list[static_cast<size_type>(observer_event::change)])
+        {
+            changed_set.remove(value);
+        }
+
+        for (const auto event : {observer_event::remove, observer_event::add, observer_event::change})
+        {
+            const auto& batch = batch_list[static_cast<size_type>(event)];
+
+            if (batch.empty())
+            {
+                continue;
+            }
+
+            for (size_type i = 0; i < entry_list.size(); i++)
+            {
+                if (entry_list[i].event == event)
+                {
+                    entry_list[i].callback(std::span<const entity>(batch));
+                }
+            }
+        }
+    }
+
+    inline void observer_list::clear()
+    {
+        for (const auto value : get_list(observer_event::add))
+        {
+            added_set.remove(value);
+        }
+
+        for (const auto value : get_list(observer_event::change))
+        {
+            changed_set.remove(value);
+        }
+
+        for (auto& list : entity_list)
+        {
+            list.clear();
+        }
+    }
+
+    inline void observer_list::push(const observer_event event, sparse_set<size_type>& position_set,
+                                    const entity value)
+    {
+        auto& list = get_list(event);
+
+        if (position_set.get(value) == nullptr)
+        {
+            position_set.set(value, list.size());
+            list.push_back(value);
+        }
+    }
+
+    // swap-removes value from the pending list of event, false when it was not pending.
+    inline bool observer_list::drop(const observer_event event, sparse_set<size_type>& position_set,
+                                    const entity value)
+    {
+        const auto position = position_set.get(value);
+
+        if (position == nullptr)
+        {
+            return false;
+        }
+
+        auto& list = get_list(event);
+        const auto index = *position;
+        const auto last = list.back();
+
+        list[index] = last;
+        list.pop_back();
+
+        if (last != value)
+        {
+            *position_set.get(last) = index;
+        }
+
+        position_set.remove(value);
+
+        return true;
+    }
+
+    inline std::vector<entity>& observer_list::get_list(const observer_event event)
+    {
+        return entity_list[static_cast<size_type>(event)];
+    }
+} // namespace nyx::ecs::detail
@@ -6,16 +6,50 @@
 #pragma once
 
 #include<ranges>
+#include <array>
 #include <atomic>
+#include <memory>
 #include <mutex>
+#include <optional>
 #include <shared_mutex>
+#include <span>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 #include <nyx/dense_map.hpp>
+#include <nyx/observer.hpp>
+#include <nyx/snapshot.hpp>
 #include <nyx/type_info.hpp>
 #include <nyx/type_utility.hpp>
 #include <nyx/table.hpp>
+#include <nyx/worker_pool.hpp>
+#include <nyx/zone_map.hpp>
 
 namespace nyx::ecs::detail
 {
+    template <typename T>
+    concept trivial_component = std::is_trivially_copyable_v<T> && std::is_same_v<T, std::remove_cvref_t<T>>;
+
+    // components declaring `static constexpr bool shared = true` are stored once per chunk instead of once per row.
+    // every distinct value holds at least one chunk of its own, sized for chunk_capacity rows, so they suit values
+    // many entities have in common; a value carried by a handful of entities costs a mostly empty chunk each.
+    template <typename T>
+    concept shared_component = trivial_component<T> && requires { requires T::shared; };
+
+    // chunks are keyed by the raw bytes of their shared components, so equal values must have equal bytes:
+    // no padding and no floating point members (0.0 and -0.0 compare equal but differ bitwise).
+    template <typename T>
+    concept shared_key_component = shared_component<T> && std::has_unique_object_representations_v<T>;
+
+    template <typename... Ts>
+    concept read_only_shared = ((!shared_component<std::remove_const_t<Ts>> || std::is_const_v<Ts>) && ...);
+
+
+    template <typename... Ts>
+    class static_query;
+    class dynamic_query;
+
+
     class registry
     {
     public:
@@ -30,11 +64,108 @@ namespace nyx::ecs::detail
         template <typename... Args>
         std::vector<table*> get_matched_arch_types();
 
+        entity create();
+        template <typename... Ts>
+        entity create(Ts&&... values);
+        void destroy(entity value);
+        bool valid(entity value);
+
+        template <typename T>
+        void emplace(entity value, T&& component);
+        template <typename T>
+        void remove(entity value);
+        template <typename T>
+        bool has(entity value);
+        template <typename T>
+        T* get(entity value);
+
+        // registers a component that only exists at runtime, e.g. one declared by a script or a data file.
+        // registering a name again hands back the existing type when the layout agrees, nullptr on conflicts.
+        // shared runtime components key their chunks by raw bytes, the caller keeps padding zeroed.
+        const type_info* register_type(std::string_view name, size_type size, size_type alignment,
+                                       std::vector<type_field> field_list = {}, bool shared = false);
+
+        // type-erased emplace, remove, has and get for components addressed by their type index.
+        bool emplace(entity value, size_type type_index, const void* data);
+        bool remove(entity value, size_type type_index);
+        bool has(entity value, size_type type_index);
+        // marks the column as written, shared columns are read-only and only change through emplace.
+        std::byte* get(entity value, size_type type_index);
+
+        // resolves many entities at once: index lookups for the next batch are prefetched while the current batch
+        // resolves its rows, and every row is prefetched before being handed out. missing components yield nullptr.
+        template <typename... Ts>
+        void get_many(std::span<const entity> values, std::type_identity_t<std::span<std::tuple<Ts*...>>> out);
+
+        // same pipeline as get_many, but copies the components out; returns how many entities were fully resolved,
+        // out is left untouched for entities missing any of Ts.
+        template <typename... Ts>
+        size_type copy_many(std::span<const entity> values, std::type_identity_t<std::span<std::tuple<Ts...>>> out);
+
+        // func(entity, Ts&...) for every entity holding all of Ts, non-const columns are marked as written.
+        template <typename... Ts, typename Func>
+        void each(Func&& func);
+
+        // func(std::span<entity>, std::span<T>... | const T&...) once per chunk, shared components come as one value.
+        template <typename... Ts, typename Func>
+        void each_chunk(Func&& func);
+
+        // each_chunk spread over a worker_pool, every chunk is queued on the numa node its memory was placed on.
+        // func runs concurrently for different chunks and must not change the structure of the registry.
+        template <typename... Ts, typename Func>
+        void each_chunk_parallel(worker_pool& pool, Func&& func);
+
+        // copies the Ts columns of every chunk into an immutable snapshot. a chunk column whose version and size did
+        // not move since previous is shared with previous instead of copied.
+        template <typename... Ts>
+        std::shared_ptr<const snapshot> take_snapshot(const std::shared_ptr<const snapshot>& previous = nullptr);
+
+        // tables created from now on allocate their chunks through allocator, nullptr restores plain heap chunks.
+        void set_chunk_allocator(std::shared_ptr<chunk_allocator> allocator);
+
+        // like each, but only visits entities whose T lies in [lo, hi]; chunks are skipped through their zone maps.
+        template <typename T, typename... Ts, typename Func>
+        void each_in_range(const T& lo, const T& hi, Func&& func);
+
+        // callback(std::span<const entity>) is handed the entities that got T added, removed or changed, one span per
+        // event kind at flush_observers(). only observed types record events; returns an id for unobserve.
+        // writes through get, each and each_chunk are not observed, report them with patch.
+        template <typename T>
+        size_type observe(observer_event event, observer_callback callback);
+        bool unobserve(size_type id);
+
+        // func(T&) on the component of value, recorded as a change. returns false when value does not hold T.
+        template <typename T, typename Func>
+        bool patch(entity value, Func&& func);
+
+        // delivers every event recorded since the last flush; observers must not be added or removed from callbacks.
+        void flush_observers();
+
+        // moves every entity of staging into this registry, typically after a worker thread built it off the main
+        // thread. types are matched by name and registered here when missing, every staging chunk is spliced into the
+        // table with the same components, and entities get fresh ids in bulk. returns the new id of every staging
+        // entity indexed by its old id, invalid_id for unused ids, so references stored in components can be fixed up.
+        // returns nullopt and moves nothing when a type exists on both sides with a different layout, or when staging
+        // is this registry. staging is left empty with its types and tables in place, ready to build the next batch.
+        std::optional<std::vector<entity>> merge(registry& staging);
+
     protected:
+        template <typename... Ts>
+        friend class static_query;
+        friend class dynamic_query;
+
         std::atomic<size_type> type_count_;
-        dense_map<table_id, table> table_map_;
         flex_array<type_info> type_info_list_;
         dense_map<std::string, size_type> type_info_index_map_;
+        dense_map<table_id, size_type> table_index_map_;
+        std::vector<std::unique_ptr<table>> table_list_;
+        sparse_set<entity_location> entity_location_set_;
+        std::vector<entity> free_entity_list_;
+        size_type entity_count_{0};
+        std::vector<std::unique_ptr<zone_map_base>> zone_map_list_;
+        std::shared_ptr<chunk_allocator> chunk_allocator_;
+        std::vector<std::unique_ptr<observer_list>> observer_list_;
+        size_type observer_count_{0};
 
     private:
         size_type get_type_index();
@@ -42,6 +173,39 @@ namespace nyx::ecs::detail
         template <typename T>
         type_info create_type_info();
 
+        template <typename... Ts>
+        std::array<size_type, sizeof...(Ts)> get_type_index_list();
+
+        template <typename... Ts, size_t... I>
+        std::tuple<Ts*...> get_columns(table& owner, const std::array<size_type, sizeof...(Ts)>& slot_list,
+                                       size_type chunk, std::index_sequence<I...>);
+
+        template <typename T>
+        zone_map<T>& get_zone_map();
+
+        template <typename... Ts, typename Sink>
+        void resolve_many(std::span<const entity> values, Sink&& sink);
+
+        template <typename T>
+        static T& get_row(T* column, size_type row);
+
+        template <typename T>
+        static decltype(auto) get_chunk_view(T* column, size_type count);
+
+        const type_info* add_type_info(std::string_view name, size_type size, size_type alignment,
+                                       std::vector<type_field> field_list, bool shared);
+        table* get_or_create_table(const std::vector<size_type>& column_index_list);
+        entity acquire_entity();
+        void clear_entities();
+        void relocate(entity value, size_type chunk, size_type row);
+        std::vector<std::byte> make_shared_key(const entity_location& location, const table* target);
+        void move_entity(entity value, entity_location& location, table* target,
+                         const std::vector<std::byte>& shared_key);
+        void notify(size_type type_index, observer_event event, entity value);
+
+        template <typename T>
+        void write_component(const entity_location& location, T&& component);
+
         std::shared_mutex register_type_mutex_;
     };
 
@@ -76,19 +240,644 @@ namespace nyx::ecs::detail
     template <typename T>
     type_info registry::create_type_info()
     {
+        static_assert(alignof(T) <= chunk_alignment, "chunk buffers are only aligned to chunk_alignment.");
+        static_assert(!shared_component<T> || shared_key_component<T>,
+                      "shared components are compared bytewise, padding and floating point members are not allowed.");
+
         return type_info{.size = sizeof(T),
                          .index = get_type_index(),
                          .name = string(type_utility::get_type_name<T>()),
-                         .alignment = alignof(T)
+                         .alignment = alignof(T),
+                         .shared = shared_component<T>
         };
     }
 
     template <typename... Args>
     std::vector<table*> registry::get_matched_arch_types()
     {
-        auto type_ids = std::vector{(get_type_info<Args>()->index)...};
+        auto type_ids = std::vector{(get_type_info<std::remove_const_t<Args>>()->index)...};
+        std::sort(type_ids.begin(), type_ids.end());
+
+        std::vector<table*> matched_list;
+
+        for (const auto& owner : table_list_)
+        {
+            if (owner->has_columns(type_ids))
+            {
+                matched_list.push_back(owner.get());
+            }
+        }
+
+        return matched_list;
+    }
+
+    template <typename... Ts>
+    entity registry::create(Ts&&... values)
+    {
+        static_assert((trivial_component<std::remove_cvref_t<Ts>> && ...), "components must be trivially copyable.");
+
+        const auto value = acquire_entity();
+        const auto owner = get_or_create_table({get_type_info<std::remove_cvref_t<Ts>>()->index...});
+        std::vector<std::byte> shared_key(owner->shared_size);
+
+        (
+            [&]
+            {
+                if constexpr (shared_component<std::remove_cvref_t<Ts>>)
+                {
+                    const auto index = get_type_info<std::remove_cvref_t<Ts>>()->index;
+                    const auto& column = owner->column_list[owner->find_column(index)];
+                    std::memcpy(shared_key.data() + column.offset, &values, sizeof(values));
+                }
+            }(),
+            ...);
+
+        auto location = owner->allocate(value, shared_key.data());
+
+        (write_component(location, std::forward<Ts>(values)), ...);
+        entity_location_set_.set(value, std::move(location));
+        (notify(get_type_info<std::remove_cvref_t<Ts>>()->index, observer_event::add, value), ...);
+
+        return value;
+    }
+
+    template <typename T>
+    void registry::emplace(const entity value, T&& component)
+    {
+        using component_type = std::remove_cvref_t<T>;
+        static_assert(trivial_component<component_type>, "components must be trivially copyable.");
+
+        // copied first, component may live in a row the move below is about to overwrite
+        const component_type data = component;
+        emplace(value, get_type_info<component_type>()->index, &data);
+    }
+
+    template <typename T>
+    void registry::remove(const entity value)
+    {
+        remove(value, get_type_info<T>()->index);
+    }
+
+    template <typename T>
+    bool registry::has(const entity value)
+    {
+        return has(value, get_type_info<T>()->index);
+    }
+
+    template <typename T>
+    T* registry::get(const entity value)
+    {
+        static_assert(read_only_shared<T>, "shared components are read-only, change them through emplace.");
+
+        const auto location = entity_location_set_.get(value);
+
+        if (location == nullptr)
+        {
+            return nullptr;
+        }
+
+        const auto slot = location->owner->find_column(get_type_info<std::remove_const_t<T>>()->index);
+
+        if (!validate_id(slot))
+        {
+            return nullptr;
+        }
+
+        if constexpr (!std::is_const_v<T>)
+        {
+            location->owner->touch(slot, location->chunk);
+        }
+
+        return reinterpret_cast<T*>(location->owner->get(slot, location->chunk, location->row));
+    }
+
+    template <typename... Ts>
+    void registry::get_many(const std::span<const entity> values,
+                            std::type_identity_t<std::span<std::tuple<Ts*...>>> out)
+    {
+        static_assert(read_only_shared<Ts...>, "shared components are read-only, change them through emplace.");
+
+        resolve_many<Ts...>(values, [&](const size_type i, const std::tuple<Ts*...>& row) { out[i] = row; });
+    }
+
+    template <typename... Ts>
+    size_type registry::copy_many(const std::span<const entity> values,
+                                  std::type_identity_t<std::span<std::tuple<Ts...>>> out)
+    {
+        size_type resolved = 0;
+
+        resolve_many<const Ts...>(values,
+                                  [&](const size_type i, const std::tuple<const Ts*...>& row)
+                                  {
+                                      if (((std::get<const Ts*>(row) != nullptr) && ...))
+                                      {
+                                          out[i] = {*std::get<const Ts*>(row)...};
+                                          resolved++;
+                                      }
+                                  });
+
+        return resolved;
+    }
+
+    template <typename... Ts, typename Func>
+    void registry::each(Func&& func)
+    {
+        static_assert(read_only_shared<Ts...>, "shared components are read-only, change them through emplace.");
+
+        const auto type_index_list = get_type_index_list<std::remove_const_t<Ts>...>();
+        auto sorted_type_index_list = std::vector(type_index_list.begin(), type_index_list.end());
+        std::sort(sorted_type_index_list.begin(), sorted_type_index_list.end());
+
+        for (const auto& owner : table_list_)
+        {
+            if (owner->size == 0 || !owner->has_columns(sorted_type_index_list))
+            {
+                continue;
+            }
+
+            std::array<size_type, sizeof...(Ts)> slot_list{};
+            std::ranges::transform(type_index_list, slot_list.begin(),
+                                   [&](const size_type index) { return owner->find_column(index); });
+
+            for (size_type chunk = 0; chunk < owner->chunk_list.size(); chunk++)
+            {
+                const auto count = owner->chunk_list[chunk].size;
+                const auto entities = owner->entities(chunk);
+                const auto columns =
+                    get_columns<Ts...>(*owner, slot_list, chunk, std::index_sequence_for<Ts...>{});
+
+                for (size_type row = 0; row < count; row++)
+                {
+                    std::apply([&](auto... column) { func(entities[row], get_row(column, row)...); }, columns);
+                }
+            }
+        }
+    }
+
+    template <typename... Ts, typename Func>
+    void registry::each_chunk(Func&& func)
+    {
+        static_assert(read_only_shared<Ts...>, "shared components are read-only, change them through emplace.");
+
+        const auto type_index_list = get_type_index_list<std::remove_const_t<Ts>...>();
+        auto sorted_type_index_list = std::vector(type_index_list.begin(), type_index_list.end());
+        std::sort(sorted_type_index_list.begin(), sorted_type_index_list.end());
+
+        for (const auto& owner : table_list_)
+        {
+            if (owner->size == 0 || !owner->has_columns(sorted_type_index_list))
+            {
+                continue;
+            }
+
+            std::array<size_type, sizeof...(Ts)> slot_list{};
+            std::ranges::transform(type_index_list, slot_list.begin(),
+                                   [&](const size_type index) { return owner->find_column(index); });
+
+            for (size_type chunk = 0; chunk < owner->chunk_list.size(); chunk++)
+            {
+                const auto count = owner->chunk_list[chunk].size;
+
+                if (count == 0)
+                {
+                    continue;
+                }
+
+                const auto columns =
+                    get_columns<Ts...>(*owner, slot_list, chunk, std::index_sequence_for<Ts...>{});
+
+                std::apply([&](auto... column)
+                           { func(std::span(owner->entities(chunk), count), get_chunk_view(column, count)...); },
+                           columns);
+            }
+        }
+    }
+
+    template <typename... Ts, typename Func>
+    void registry::each_chunk_parallel(worker_pool& pool, Func&& func)
+    {
+        static_assert(read_only_shared<Ts...>, "shared components are read-only, change them through emplace.");
+
+        const auto type_index_list = get_type_index_list<std::remove_const_t<Ts>...>();
+        auto sorted_type_index_list = std::vector(type_index_list.begin(), type_index_list.end());
+        std::sort(sorted_type_index_list.begin(), sorted_type_index_list.end());
+
+        struct chunk_task
+        {
+            table* owner;
+            size_type chunk;
+            std::array<size_type, sizeof...(Ts)> slot_list;
+        };
+
+        std::vector<chunk_task> task_list;
+        std::vector<size_type> node_list;
+
+        for (const auto& owner : table_list_)
+        {
+            if (owner->size == 0 || !owner->has_columns(sorted_type_index_list))
+            {
+                continue;
+            }
+
+            std::array<size_type, sizeof...(Ts)> slot_list{};
+            std::ranges::transform(type_index_list, slot_list.begin(),
+                                   [&](const size_type index) { return owner->find_column(index); });
+
+            for (size_type chunk = 0; chunk < owner->chunk_list.size(); chunk++)
+            {
+                if (owner->chunk_list[chunk].size != 0)
+                {
+                    task_list.push_back({owner.get(), chunk, slot_list});
+                    node_list.push_back(owner->chunk_list[chunk].node);
+                }
+            }
+        }
+
+        pool.run(node_list,
+                 [&](const size_type item, size_type)
+                 {
+                     const auto& [owner, chunk, slot_list] = task_list[item];
+                     const auto count = owner->chunk_list[chunk].size;
+                     const auto columns =
+                         get_columns<Ts...>(*owner, slot_list, chunk, std::index_sequence_for<Ts...>{});
+
+                     std::apply([&](auto... column)
+                                { func(std::span(owner->entities(chunk), count), get_chunk_view(column, count)...); },
+                                columns);
+                 });
+    }
+
+    template <typename... Ts>
+    std::shared_ptr<const snapshot> registry::take_snapshot(const std::shared_ptr<const snapshot>& previous)
+    {
+        static_assert(((trivial_component<Ts> && !shared_component<Ts>) && ...),
+                      "snapshots only capture per-row components.");
+        static_assert(((sizeof(Ts) <= snapshot::max_element_size) && ...), "component is too large to snapshot.");
+
+        const auto type_index_list = get_type_index_list<Ts...>();
+        auto result = std::make_shared<snapshot>();
+        result->type_name_list_ = {string(type_utility::get_type_name<Ts>())...};
+        result->element_size_list_ = {sizeof(Ts)...};
+        result->frame_ = previous != nullptr ? previous->frame_ + 1 : 0;
+        result->page_index_list_.resize(table_list_.size());
+
+        const auto reuse = previous != nullptr && previous->type_name_list_ == result->type_name_list_;
+
+        for (const auto& owner : table_list_)
+        {
+            std::array<size_type, sizeof...(Ts)> slot_list{};
+            std::ranges::transform(type_index_list, slot_list.begin(),
+                                   [&](const size_type index) { return owner->find_column(index); });
+
+            if (owner->size == 0 || std::ranges::none_of(slot_list, validate_id))
+            {
+                continue;
+            }
+
+            auto& page_index_list = result->page_index_list_[owner->index];
+            page_index_list.assign(owner->chunk_list.size(), invalid_id);
+
+            for (size_type chunk = 0; chunk < owner->chunk_list.size(); chunk++)
+            {
+                const auto& source = owner->chunk_list[chunk];
+
+                if (source.size == 0)
+                {
+                    continue;
+                }
+
+                const auto old = reuse ? previous->find_page(owner->index, chunk) : nullptr;
+                const auto same_rows = old != nullptr && old->size == source.size;
+
+                snapshot::page current{.table_index = owner->index,
+                                       .chunk = chunk,
+                                       .size = source.size,
+                                       .entity_version = source.entity_version};
+
+                if (same_rows && old->entity_version == source.entity_version)
+                {
+                    current.entity_list = old->entity_list;
+                }
+                else
+                {
+                    const auto entities = owner->entities(chunk);
+                    current.entity_list = std::make_shared<const std::vector<entity>>(entities, entities + source.size);
+                }
+
+                for (size_type i = 0; i < sizeof...(Ts); i++)
+                {
+                    const auto slot = slot_list[i];
+                    const auto version = validate_id(slot) ? source.version_list[slot] : 0;
+                    current.version_list.push_back(version);
+
+                    if (!validate_id(slot))
+                    {
+                        current.column_list.emplace_back();
+                    }
+                    else if (same_rows && old->column_list[i] != nullptr && old->version_list[i] == version)
+                    {
+                        current.column_list.push_back(old->column_list[i]);
+                    }
+                    else
+                    {
+                        const auto data = owner->column(slot, chunk);
+                        current.column_list.push_back(std::make_shared<const std::vector<std::byte>>(
+                            data, data + owner->column_list[slot].size * source.size));
+                        result->copy_count_++;
+                    }
+                }
+
+                page_index_list[chunk] = result->page_list_.size();
+                result->size_ += source.size;
+                result->page_list_.push_back(std::move(current));
+            }
+        }
+
+        return result;
+    }
+
+    template <typename T, typename... Ts, typename Func>
+    void registry::each_in_range(const T& lo, const T& hi, Func&& func)
+    {
+        static_assert(!shared_component<T> && read_only_shared<Ts...>,
+                      "range keys must be per-row and shared components are read-only.");
+
+        const auto type_index_list = get_type_index_list<T, std::remove_const_t<Ts>...>();
+        auto sorted_type_index_list = std::vector(type_index_list.begin(), type_index_list.end());
+        std::sort(sorted_type_index_list.begin(), sorted_type_index_list.end());
+
+        auto& zones = get_zone_map<T>();
+        std::array<size_type, chunk_capacity> selection{};
+
+        for (const auto& owner : table_list_)
+        {
+            if (owner->size == 0 || !owner->has_columns(sorted_type_index_list))
+            {
+                continue;
+            }
+
+            std::array<size_type, sizeof...(Ts)> slot_list{};
+            std::transform(type_index_list.begin() + 1, type_index_list.end(), slot_list.begin(),
+                           [&](const size_type index) { return owner->find_column(index); });
+            const auto key_slot = owner->find_column(type_index_list[0]);
+
+            for (size_type chunk = 0; chunk < owner->chunk_list.size(); chunk++)
+            {
+                const auto count = owner->chunk_list[chunk].size;
+
+                if (count == 0)
+                {
+                    continue;
+                }
+
+                const auto& bounds = zones.get(*owner, key_slot, chunk);
+
+                if (bounds.max < lo || hi < bounds.min)
+                {
+                    continue;
+                }
+
+                const auto keys = reinterpret_cast<const T*>(owner->column(key_slot, chunk));
+                const auto entities = owner->entities(chunk);
+                const auto columns =
+                    get_columns<Ts...>(*owner, slot_list, chunk, std::index_sequence_for<Ts...>{});
+
+                if (!(bounds.min < lo) && !(hi < bounds.max))
+                {
+                    for (size_type row = 0; row < count; row++)
+                    {
+                        std::apply([&](auto... column) { func(entities[row], keys[row], get_row(column, row)...); },
+                                   columns);
+                    }
+
+                    continue;
+                }
+
+                const auto selected = select_range(keys, count, lo, hi, selection.data());
+
+                for (size_type i = 0; i < selected; i++)
+                {
+                    const auto row = selection[i];
+                    std::apply([&](auto... column) { func(entities[row], keys[row], get_row(column, row)...); },
+                               columns);
+                }
+            }
+        }
+    }
+
+    template <typename T>
+    size_type registry::observe(const observer_event event, observer_callback callback)
+    {
+        const auto index = get_type_info<T>()->index;
+
+        if (observer_list_.size() <= index)
+        {
+            observer_list_.resize(index + 1);
+        }
+
+        if (observer_list_[index] == nullptr)
+        {
+            observer_list_[index] = std::make_unique<observer_list>();
+        }
+
+        const auto id = observer_count_++;
+        observer_list_[index]->add(id, event, std::move(callback));
+
+        return id;
+    }
+
+    template <typename T, typename Func>
+    bool registry::patch(const entity value, Func&& func)
+    {
+        static_assert(!shared_component<T>, "shared components are read-only, change them through emplace.");
+
+        const auto component = get<T>(value);
+
+        if (component == nullptr)
+        {
+            return false;
+        }
+
+        func(*component);
+        notify(get_type_info<T>()->index, observer_event::change, value);
+
+        return true;
+    }
+
+
+    template <typename... Ts>
+    std::array<size_type, sizeof...(Ts)> registry::get_type_index_list()
+    {
+        return {get_type_info<Ts>()->index...};
+    }
+
+    template <typename... Ts, size_t... I>
+    std::tuple<Ts*...> registry::get_columns(table& owner, const std::array<size_type, sizeof...(Ts)>& slot_list,
+                                             const size_type chunk, std::index_sequence<I...>)
+    {
+        (
+            [&]
+            {
+                if constexpr (!std::is_const_v<Ts>)
+                {
+                    owner.touch(slot_list[I], chunk);
+                }
+            }(),
+            ...);
+
+        return {reinterpret_cast<Ts*>(owner.column(slot_list[I], chunk))...};
+    }
+
+    // three stages per batch of batch_size entities: the sparse slots of batch n + 2 and the packed locations of
+    // batch n + 1 are prefetched, batch n resolves its locations, then its rows are prefetched and finally gathered.
+    template <typename... Ts, typename Sink>
+    void registry::resolve_many(const std::span<const entity> values, Sink&& sink)
+    {
+        constexpr size_type batch_size = 32;
+
+        const auto type_index_list = get_type_index_list<std::remove_const_t<Ts>...>();
+        std::array<std::tuple<Ts*...>, batch_size> row_list{};
+        std::array<size_type, sizeof...(Ts)> slot_list{};
+        const table* cached_owner = nullptr;
+
+        for (size_type i = 0; i < std::min(2 * batch_size, values.size()); i++)
+        {
+            entity_location_set_.prefetch(values[i]);
+        }
+
+        for (size_type i = 0; i < std::min(batch_size, values.size()); i++)
+        {
+            entity_location_set_.prefetch_value(values[i]);
+        }
+
+        for (size_type begin = 0; begin < values.size(); begin += batch_size)
+        {
+            const auto end = std::min(begin + batch_size, values.size());
+            const auto next_end = std::min(end + batch_size, values.size());
+
+            for (size_type i = next_end; i < std::min(next_end + batch_size, values.size()); i++)
+            {
+                entity_location_set_.prefetch(values[i]);
+            }
+
+            for (size_type i = end; i < next_end; i++)
+            {
+                entity_location_set_.prefetch_value(values[i]);
+            }
+
+            for (size_type i = begin; i < end; i++)
+            {
+                auto& row = row_list[i - begin];
+                const auto location = entity_location_set_.get(values[i]);
+
+                if (location == nullptr)
+                {
+                    row = {};
+                    continue;
+                }
+
+                const auto owner = location->owner;
+
+                if (owner != cached_owner)
+                {
+                    std::ranges::transform(type_index_list, slot_list.begin(),
+                                           [&](const size_type index) { return owner->find_column(index); });
+                    cached_owner = owner;
+                }
+
+                [&]<size_t... I>(std::index_sequence<I...>)
+                {
+                    row = {(validate_id(slot_list[I])
+                                ? reinterpret_cast<Ts*>(owner->get(slot_list[I], location->chunk, location->row))
+                                : nullptr)...};
+
+                    (
+                        [&]
+                        {
+                            if constexpr (!std::is_const_v<Ts>)
+                            {
+                                if (validate_id(slot_list[I]))
+                                {
+                                    owner->touch(slot_list[I], location->chunk);
+                                }
+                            }
+                        }(),
+                        ...);
+                }(std::index_sequence_for<Ts...>{});
+            }
+
+            for (size_type i = begin; i < end; i++)
+            {
+                std::apply([](const auto*... column) { (detail::prefetch(column), ...); }, row_list[i - begin]);
+            }
+
+            for (size_type i = begin; i < end; i++)
+            {
+                sink(i, row_list[i - begin]);
+            }
+        }
+    }
+
+    template <typename T>
+    zone_map<T>& registry::get_zone_map()
+    {
+        const auto index = get_type_info<T>()->index;
+
+        if (zone_map_list_.size() <= index)
+        {
+            zone_map_list_.resize(index + 1);
+        }
+
+        if (zone_map_list_[index] == nullptr)
+        {
+            zone_map_list_[index] = std::make_unique<zone_map<T>>();
+        }
+
+        return static_cast<zone_map<T>&>(*zone_map_list_[index]);
+    }
+
+    template <typename T>
+    T& registry::get_row(T* column, const size_type row)
+    {
+        if constexpr (shared_component<std::remove_const_t<T>>)
+        {
+            return *column;
+        }
+        else
+        {
+            return column[row];
+        }
+    }
+
+    template <typename T>
+    decltype(auto) registry::get_chunk_view(T* column, const size_type count)
+    {
+        if constexpr (shared_component<std::remove_const_t<T>>)
+        {
+            return static_cast<T&>(*column);
+        }
+        else
+        {
+            return std::span<T>(column, count);
+        }
+    }
+
+    // shared components are written into the chunk's shared key before allocation, so only per-row data lands here.
+    template <typename T>
+    void registry::write_component(const entity_location& location, T&& component)
+    {
+        using component_type = std::remove_cvref_t<T>;
+
+        if constexpr (shared_component<component_type>)
+        {
+            return;
+        }
 
-        return {};
+        const auto slot = location.owner->find_column(get_type_info<component_type>()->index);
+        const auto data = location.owner->get(slot, location.chunk, location.row);
+
+        std::construct_at(reinterpret_cast<component_type*>(data), std::forward<T>(component));
+        location.owner->touch(slot, location.chunk);
     }
 
 
@@ -119,5 +908,411 @@ namespace nyx::ecs::detail
 
     inline size_type registry::get_type_index() { return type_count_++; }
 
+    inline entity registry::create()
+    {
+        const auto value = acquire_entity();
+        entity_location_set_.set(value, get_or_create_table({})->allocate(value));
+
+        return value;
+    }
+
+    inline void registry::destroy(const entity value)
+    {
+        const auto location = entity_location_set_.get(value);
+
+        if (location == nullptr)
+        {
+            return;
+        }
+
+        const auto [owner, chunk, row] = *location;
+
+        for (const auto index : owner->column_index_list)
+        {
+            notify(index, observer_event::remove, value);
+        }
+
+        relocate(owner->deallocate(chunk, row), chunk, row);
+        entity_location_set_.remove(value);
+        free_entity_list_.push_back(value);
+    }
+
+    inline bool registry::valid(const entity value) { return entity_location_set_.get(value) != nullptr; }
+
+    inline const type_info* registry::register_type(const std::string_view name, const size_type size,
+                                                    const size_type alignment, std::vector<type_field> field_list,
+                                                    const bool shared)
+    {
+        const auto valid_layout =
+            alignment != 0 && (alignment & (alignment - 1)) == 0 && alignment <= chunk_alignment &&
+            size % alignment == 0 &&
+            std::ranges::all_of(field_list, [&](const type_field& field) { return field.offset + field.size <= size; });
+
+        if (!valid_layout)
+        {
+            return nullptr;
+        }
+
+        const auto info = add_type_info(name, size, alignment, field_list, shared);
+        const auto same = info->size == size && info->alignment == alignment && info->shared == shared &&
+                          info->field_list == field_list;
+
+        return same ? info : nullptr;
+    }
+
+    inline bool registry::emplace(const entity value, const size_type type_index, const void* data)
+    {
+        const auto info = get_type_info(type_index);
+        auto location = entity_location_set_.get(value);
+
+        if (info == nullptr || location == nullptr)
+        {
+            return false;
+        }
+
+        const auto slot = location->owner->find_column(type_index);
+        auto target = location->owner;
+
+        if (!validate_id(slot))
+        {
+            auto column_index_list = location->owner->column_index_list;
+            column_index_list.push_back(type_index);
+            target = get_or_create_table(column_index_list);
+        }
+
+        const auto target_slot = target->find_column(type_index);
+
+        if (info->shared)
+        {
+            if (validate_id(slot) &&
+                std::memcmp(location->owner->get(slot, location->chunk, location->row), data, info->size) == 0)
+            {
+                return true;
+            }
+
+            auto shared_key = make_shared_key(*location, target);
+            std::memcpy(shared_key.data() + target->column_list[target_slot].offset, data, info->size);
+            move_entity(value, *location, target, shared_key);
+        }
+        else
+        {
+            if (target != location->owner)
+            {
+                move_entity(value, *location, target, make_shared_key(*location, target));
+            }
+
+            std::memcpy(target->get(target_slot, location->chunk, location->row), data, info->size);
+            target->touch(target_slot, location->chunk);
+        }
+
+        notify(type_index, validate_id(slot) ? observer_event::change : observer_event::add, value);
+
+        return true;
+    }
+
+    inline bool registry::remove(const entity value, const size_type type_index)
+    {
+        auto location = entity_location_set_.get(value);
+
+        if (location == nullptr || !validate_id(location->owner->find_column(type_index)))
+        {
+            return false;
+        }
+
+        auto column_index_list = location->owner->column_index_list;
+        std::erase(column_index_list, type_index);
+
+        const auto target = get_or_create_table(column_index_list);
+        move_entity(value, *location, target, make_shared_key(*location, target));
+        notify(type_index, observer_event::remove, value);
+
+        return true;
+    }
+
+    inline bool registry::has(const entity value, const size_type type_index)
+    {
+        const auto location = entity_location_set_.get(value);
+
+        return location != nullptr && validate_id(location->owner->find_column(type_index));
+    }
+
+    inline std::byte* registry::get(const entity value, const size_type type_index)
+    {
+        const auto location = entity_location_set_.get(value);
+
+        if (location == nullptr)
+        {
+            return nullptr;
+        }
+
+        const auto owner = location->owner;
+        const auto slot = owner->find_column(type_index);
+
+        if (!validate_id(slot))
+        {
+            return nullptr;
+        }
+
+        if (!owner->column_list[slot].shared)
+        {
+            owner->touch(slot, location->chunk);
+        }
+
+        return owner->get(slot, location->chunk, location->row);
+    }
+
+    inline bool registry::unobserve(const size_type id)
+    {
+        return std::ranges::any_of(observer_list_, [&](const std::unique_ptr<observer_list>& observers)
+                                   { return observers != nullptr && observers->remove(id); });
+    }
 
+    inline void registry::flush_observers()
+    {
+        for (const auto& observers : observer_list_)
+        {
+            if (observers != nullptr)
+            {
+                observers->flush();
+            }
+        }
+    }
+
+    inline void registry::set_chunk_allocator(std::shared_ptr<chunk_allocator> allocator)
+    {
+        chunk_allocator_ = std::move(allocator);
+    }
+
+    inline std::optional<std::vector<entity>> registry::merge(registry& staging)
+    {
+        if (&staging == this)
+        {
+            return std::nullopt;
+        }
+
+        const size_type staging_type_count = staging.type_count_;
+
+        for (size_type index = 0; index < staging_type_count; index++)
+        {
+            const auto& info = staging.type_info_list_[index];
+
+            if (const auto existing = get_type_info(info.name);
+                existing != nullptr && (existing->size != info.size || existing->alignment != info.alignment ||
+                                        existing->shared != info.shared || existing->field_list != info.field_list))
+            {
+                return std::nullopt;
+            }
+        }
+
+        std::vector<size_type> type_map(staging_type_count);
+
+        for (size_type index = 0; index < staging_type_count; index++)
+        {
+            const auto& info = staging.type_info_list_[index];
+            type_map[index] = add_type_info(info.name, info.size, info.alignment, info.field_list, info.shared)->index;
+        }
+
+        std::vector<entity> entity_map(staging.entity_count_, invalid_id);
+
+        for (const auto& source : staging.table_list_)
+        {
+            if (source->size == 0)
+            {
+                continue;
+            }
+
+            std::vector<size_type> column_index_list;
+            std::ranges::transform(source->column_index_list, std::back_inserter(column_index_list),
+                                   [&](const size_type index) { return type_map[index]; });
+
+            const auto target = get_or_create_table(column_index_list);
+            std::vector<size_type> slot_list;
+            std::ranges::transform(column_index_list, std::back_inserter(slot_list),
+                                   [&](const size_type index) { return target->find_column(index); });
+
+            for (size_type chunk = 0; chunk < source->chunk_list.size(); chunk++)
+            {
+                const auto count = source->chunk_list[chunk].size;
+
+                if (count == 0)
+                {
+                    continue;
+                }
+
+                const auto target_chunk = target->splice(*source, chunk, slot_list);
+                const auto entities = target->entities(target_chunk);
+
+                for (size_type row = 0; row < count; row++)
+                {
+                    const auto value = acquire_entity();
+                    entity_map[entities[row]] = value;
+                    entities[row] = value;
+                    entity_location_set_.set(value, {target, target_chunk, row});
+                }
+
+                for (const auto index : column_index_list)
+                {
+                    for (size_type row = 0; row < count; row++)
+                    {
+                        notify(index, observer_event::add, entities[row]);
+                    }
+                }
+            }
+        }
+
+        staging.clear_entities();
+
+        return entity_map;
+    }
+
+    inline const type_info* registry::add_type_info(const std::string_view name, const size_type size,
+                                                    const size_type alignment, std::vector<type_field> field_list,
+                                                    const bool shared)
+    {
+        {
+            std::lock_guard lock(register_type_mutex_);
+
+            if (const auto index = type_info_index_map_.get(name); index != nullptr)
+            {
+                return &type_info_list_[*index];
+            }
+
+            auto type_info = detail::type_info{.size = size,
+                                               .index = get_type_index(),
+                                               .name = string(name),
+                                               .alignment = alignment,
+                                               .shared = shared,
+                                               .field_list = std::move(field_list)};
+            auto index = type_info.index;
+            type_info_list_.ensure(index);
+            type_info_list_[index] = std::move(type_info);
+            type_info_index_map_.set(string(name), index);
+        }
+
+        return get_type_info(name);
+    }
+
+    inline table* registry::get_or_create_table(const std::vector<size_type>& column_index_list)
+    {
+        const auto id = table_id::create(column_index_list);
+
+        if (const auto index = table_index_map_.get(id); index != nullptr)
+        {
+            return table_list_[*index].get();
+        }
+
+        std::vector<const type_info*> type_info_list;
+
+        for (const auto index : id.sorted_column_index_list)
+        {
+            type_info_list.push_back(get_type_info(index));
+        }
+
+        const auto& owner = table_list_.emplace_back(std::make_unique<table>(id, type_info_list, chunk_allocator_));
+        owner->index = table_list_.size() - 1;
+        table_index_map_.set(id, owner->index);
+
+        return owner.get();
+    }
+
+    inline entity registry::acquire_entity()
+    {
+        if (free_entity_list_.empty())
+        {
+            return entity_count_++;
+        }
+
+        const auto value = free_entity_list_.back();
+        free_entity_list_.pop_back();
+
+        return value;
+    }
+
+    // forgets every entity while keeping types and tables, so a staging registry can be filled again after a merge.
+    inline void registry::clear_entities()
+    {
+        for (const auto& owner : table_list_)
+        {
+            owner->clear();
+        }
+
+        entity_location_set_.clear();
+        free_entity_list_.clear();
+        entity_count_ = 0;
+        zone_map_list_.clear();
+
+        for (const auto& observers : observer_list_)
+        {
+            if (observers != nullptr)
+            {
+                observers->clear();
+            }
+        }
+    }
+
+    inline void registry::relocate(const entity value, const size_type chunk, const size_type row)
+    {
+        if (!validate_id(value))
+        {
+            return;
+        }
+
+        auto location = entity_location_set_.get(value);
+        location->chunk = chunk;
+        location->row = row;
+    }
+
+    inline std::vector<std::byte> registry::make_shared_key(const entity_location& location, const table* target)
+    {
+        std::vector<std::byte> shared_key(target->shared_size);
+
+        for (const auto& column : target->column_list)
+        {
+            if (!column.shared)
+            {
+                continue;
+            }
+
+            if (const auto slot = location.owner->find_column(column.index); validate_id(slot))
+            {
+                std::memcpy(shared_key.data() + column.offset, location.owner->get(slot, location.chunk, location.row),
+                            column.size);
+            }
+        }
+
+        return shared_key;
+    }
+
+    inline void registry::move_entity(const entity value, entity_location& location, table* target,
+                                      const std::vector<std::byte>& shared_key)
+    {
+        const auto source = location.owner;
+        const auto next = target->allocate(value, shared_key.data());
+
+        for (size_type slot = 0; slot < source->column_size; slot++)
+        {
+            const auto target_slot = target->find_column(source->column_list[slot].index);
+
+            if (!validate_id(target_slot) || target->column_list[target_slot].shared)
+            {
+                continue;
+            }
+
+            std::memcpy(target->get(target_slot, next.chunk, next.row), source->get(slot, location.chunk, location.row),
+                        source->column_list[slot].size);
+            target->touch(target_slot, next.chunk);
+        }
+
+        const auto moved = source->deallocate(location.chunk, location.row);
+        relocate(moved, location.chunk, location.row);
+        location = next;
+    }
+
+    inline void registry::notify(const size_type type_index, const observer_event event, const entity value)
+    {
+        if (type_index < observer_list_.size() && observer_list_[type_index] != nullptr)
+        {
+            observer_list_[type_index]->record(event, value);
+        }
+    }
 } // namespace nyx::ecs::detail
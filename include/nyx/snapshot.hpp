@@ -0,0 +1,174 @@
+//
+// Created by loki7 on 25-7-12.
+//
+
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include <nyx/common.h>
+#include <nyx/type_utility.hpp>
+
+namespace nyx::ecs::detail
+{
+    class registry;
+    class snapshot_delta;
+
+
+    // an immutable copy of selected component columns, taken at a frame boundary by registry::take_snapshot.
+    // column copies are kept per chunk and shared with the previous snapshot when nobody wrote the chunk in between.
+    class snapshot
+    {
+    public:
+        // func(entity, const Ts&...) for every row that holds all of Ts.
+        template <typename... Ts, typename Func>
+        void each(Func&& func) const;
+
+        // func(std::span<const entity>, std::span<const Ts>...) once per captured chunk holding all of Ts.
+        template <typename... Ts, typename Func>
+        void each_chunk(Func&& func) const;
+
+        [[nodiscard]] size_type frame() const;
+        [[nodiscard]] size_type size() const;
+        // number of column copies this snapshot made instead of sharing them with the previous one.
+        [[nodiscard]] size_type copy_count() const;
+
+    private:
+        friend class registry;
+        friend class snapshot_delta;
+
+        using entity_buffer = std::shared_ptr<const std::vector<entity>>;
+        using column_buffer = std::shared_ptr<const std::vector<std::byte>>;
+
+        struct page
+        {
+            size_type table_index;
+            size_type chunk;
+            size_type size;
+            size_type entity_version;
+            entity_buffer entity_list;
+            std::vector<size_type> version_list;
+            std::vector<column_buffer> column_list;
+        };
+
+        size_type frame_{0};
+        size_type size_{0};
+        size_type copy_count_{0};
+        std::vector<string> type_name_list_{};
+        std::vector<size_type> element_size_list_{};
+        std::vector<page> page_list_{};
+        std::vector<std::vector<size_type>> page_index_list_{};
+
+        // rows larger than this are not captured, and a decoded stream claiming one is treated as corrupt.
+        static constexpr size_type max_element_size = size_type{64} * 1024;
+
+        [[nodiscard]] const page* find_page(size_type table_index, size_type chunk) const;
+
+        template <typename T>
+        // a type whose element size differs from sizeof(T) is treated as missing.
+        [[nodiscard]] size_type find_type() const;
+    };
+
+
+    // hands the latest snapshot from the simulation thread to any number of readers without a mutex;
+    // a reader keeps its snapshot alive for as long as it holds the returned pointer.
+    class snapshot_buffer
+    {
+    public:
+        void publish(std::shared_ptr<const snapshot> value);
+        [[nodiscard]] std::shared_ptr<const snapshot> acquire() const;
+
+    private:
+        std::atomic<std::shared_ptr<const snapshot>> current_{};
+    };
+
+
+    template <typename... Ts, typename Func>
+    void snapshot::each(Func&& func) const
+    {
+        each_chunk<Ts...>(
+            [&](std::span<const entity> entities, std::span<const Ts>... columns)
+            {
+                for (size_type row = 0; row < entities.size(); row++)
+                {
+                    func(entities[row], columns[row]...);
+                }
+            });
+    }
+
+    template <typename... Ts, typename Func>
+    void snapshot::each_chunk(Func&& func) const
+    {
+        const std::array<size_type, sizeof...(Ts)> slot_list{find_type<Ts>()...};
+
+        if (std::ranges::any_of(slot_list, [](const size_type slot) { return !validate_id(slot); }))
+        {
+            return;
+        }
+
+        for (const auto& current : page_list_)
+        {
+            if (std::ranges::any_of(slot_list,
+                                    [&](const size_type slot) { return current.column_list[slot] == nullptr; }))
+            {
+                continue;
+            }
+
+            [&]<size_t... I>(std::index_sequence<I...>)
+            {
+                func(std::span<const entity>(*current.entity_list),
+                     std::span(reinterpret_cast<const Ts*>(current.column_list[slot_list[I]]->data()),
+                               current.size)...);
+            }(std::index_sequence_for<Ts...>{});
+        }
+    }
+
+    template <typename T>
+    size_type snapshot::find_type() const
+    {
+        const auto it = std::ranges::find(type_name_list_, type_utility::get_type_name<T>());
+
+        if (it == type_name_list_.end())
+        {
+            return invalid_id;
+        }
+
+        const auto index = static_cast<size_type>(it - type_name_list_.begin());
+        return element_size_list_[index] == sizeof(T) ? index : invalid_id;
+    }
+
+    inline size_type snapshot::frame() const { return frame_; }
+
+    inline size_type snapshot::size() const { return size_; }
+
+    inline size_type snapshot::copy_count() const { return copy_count_; }
+
+    inline const snapshot::page* snapshot::find_page(const size_type table_index, const size_type chunk) const
+    {
+        if (page_index_list_.size() <= table_index || page_index_list_[table_index].size() <= chunk)
+        {
+            return nullptr;
+        }
+
+        const auto index = page_index_list_[table_index][chunk];
+        return validate_id(index) ? &page_list_[index] : nullptr;
+    }
+
+
+    inline void snapshot_buffer::publish(std::shared_ptr<const snapshot> value)
+    {
+        current_.store(std::move(value), std::memory_order_release);
+    }
+
+    inline std::shared_ptr<const snapshot> snapshot_buffer::acquire() const
+    {
+        return current_.load(std::memory_order_acquire);
+    }
+} // namespace nyx::ecs::detail
@@ -30,8 +30,12 @@ namespace nyx::ecs::detail
         sparse_set& operator=(sparse_set&& o) = default;
 
         T* get(size_type index);
+        void prefetch(size_type index);
+        // prefetches the packed slot of index, the sparse slot should already be cached by prefetch.
+        void prefetch_value(size_type index);
         void set(size_type index, T&& value);
         void remove(size_type index);
+        void clear();
         void shrink_to_fit();
 
     private:
@@ -43,7 +47,7 @@ namespace nyx::ecs::detail
     template <typename T>
     T* sparse_set<T>::get(const size_type index)
     {
-        if (sparse_.size() <= index)
+        if (sparse_.size() <= index || !validate_id(sparse_[index]))
         {
             return nullptr;
         }
@@ -51,6 +55,24 @@ namespace nyx::ecs::detail
         return &(packed_[sparse_[index]].value);
     }
 
+    template <typename T>
+    void sparse_set<T>::prefetch(const size_type index)
+    {
+        if (index < sparse_.size())
+        {
+            detail::prefetch(&sparse_[index]);
+        }
+    }
+
+    template <typename T>
+    void sparse_set<T>::prefetch_value(const size_type index)
+    {
+        if (index < sparse_.size() && validate_id(sparse_[index]))
+        {
+            detail::prefetch(&packed_[sparse_[index]]);
+        }
+    }
+
     template <typename T>
     void sparse_set<T>::set(const size_type index, T&& value)
     {
@@ -82,7 +104,7 @@ namespace nyx::ecs::detail
 
         const auto tail_index = size_ - 1;
         auto&& [value, move_index] = packed_[tail_index];
-        packed_[sparse_[index]] = {std::move(value), index};
+        packed_[sparse_[index]] = {std::move(value), move_index};
         sparse_[move_index] = sparse_[index];
 
         sparse_[index] = invalid_id;
@@ -90,6 +112,14 @@ namespace nyx::ecs::detail
         size_--;
     }
 
+    template <typename T>
+    void sparse_set<T>::clear()
+    {
+        size_ = 0;
+        packed_.ensure_chunk_size(0);
+        sparse_.ensure_chunk_size(0);
+    }
+
     template <typename T>
     void sparse_set<T>::shrink_to_fit()
     {
@@ -101,14 +131,14 @@ namespace nyx::ecs::detail
         else
         {
             size_type max_index = 0;
-            packed_.ensure(size_ - 1);
+            packed_.ensure_chunk_size((size_ - 1) / decltype(packed_)::chunk_size + 1);
 
             for (size_type i = 0; i < size_; i++)
             {
                 max_index = std::max(max_index, packed_[i].sparse_index);
             }
 
-            sparse_.ensure(max_index);
+            sparse_.ensure_chunk_size(max_index / decltype(sparse_)::chunk_size + 1);
         }
 
         packed_.shrink_to_fit();
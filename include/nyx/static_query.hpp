@@ -0,0 +1,187 @@
+//
+// Created by loki7 on 25-7-18.
+//
+
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <nyx/common.h>
+#include <nyx/registry.hpp>
+#include <nyx/table.hpp>
+#include <nyx/type_utility.hpp>
+
+namespace nyx::ecs::detail
+{
+    // a query over a component set fixed at compile time. the signature is sorted at compile time, type indices
+    // are resolved once per registry, and the column offsets of every matching table are bound the first time the
+    // table is seen, so iterating is a walk over raw chunk pointers without any per-table column search.
+    template <typename... Ts>
+    class static_query
+    {
+    public:
+        static constexpr size_type type_count = sizeof...(Ts);
+
+        // type names in declaration order.
+        static constexpr std::array<string_view, type_count> type_name_list{
+            type_utility::get_type_name<std::remove_const_t<Ts>>()...};
+
+        // type names sorted, duplicates are rejected at compile time.
+        static constexpr std::array<string_view, type_count> signature = []
+        {
+            auto sorted = type_name_list;
+            std::ranges::sort(sorted);
+            return sorted;
+        }();
+
+        static_assert(type_count != 0, "a static query needs at least one component.");
+        static_assert(std::ranges::adjacent_find(signature) == signature.end(), "components must be unique.");
+        static_assert((trivial_component<std::remove_const_t<Ts>> && ...), "components must be trivially copyable.");
+        static_assert(read_only_shared<Ts...>, "shared components are read-only, change them through emplace.");
+
+        explicit static_query(registry& owner);
+
+        // func(entity, Ts&...) for every entity holding all of Ts, non-const columns are marked as written.
+        template <typename Func>
+        void each(Func&& func);
+
+        // func(std::span<entity>, std::span<T>... | const T&...) once per chunk, shared components come as one value.
+        template <typename Func>
+        void each_chunk(Func&& func);
+
+        // number of tables bound so far, refreshed by each and each_chunk.
+        [[nodiscard]] size_type table_count() const;
+
+    private:
+        struct binding
+        {
+            table* owner;
+            std::array<size_type, type_count> slot_list;
+            std::array<size_type, type_count> offset_list;
+        };
+
+        registry* registry_;
+        std::array<size_type, type_count> type_index_list_{};
+        std::vector<size_type> sorted_type_index_list_{};
+        std::vector<binding> binding_list_{};
+        size_type scanned_size_{0};
+
+        // func(count, entity*, Ts*...) per non-empty chunk, with the column pointers taken from the bound offsets.
+        template <typename Func>
+        void walk(Func&& func);
+
+        void refresh();
+    };
+
+
+    template <typename... Ts>
+    static_query<Ts...>::static_query(registry& owner) :
+        registry_(&owner), type_index_list_{owner.get_type_info<std::remove_const_t<Ts>>()->index...},
+        sorted_type_index_list_(type_index_list_.begin(), type_index_list_.end())
+    {
+        std::ranges::sort(sorted_type_index_list_);
+    }
+
+    template <typename... Ts>
+    template <typename Func>
+    void static_query<Ts...>::each(Func&& func)
+    {
+        walk(
+            [&](const size_type count, const entity* entities, Ts*... columns)
+            {
+                for (size_type row = 0; row < count; row++)
+                {
+                    func(entities[row], registry::get_row(columns, row)...);
+                }
+            });
+    }
+
+    template <typename... Ts>
+    template <typename Func>
+    void static_query<Ts...>::each_chunk(Func&& func)
+    {
+        walk([&](const size_type count, entity* entities, Ts*... columns)
+             { func(std::span(entities, count), registry::get_chunk_view(columns, count)...); });
+    }
+
+    template <typename... Ts>
+    template <typename Func>
+    void static_query<Ts...>::walk(Func&& func)
+    {
+        refresh();
+
+        for (const auto& [owner, slot_list, offset_list] : binding_list_)
+        {
+            if (owner->size == 0)
+            {
+                continue;
+            }
+
+            for (size_type chunk = 0; chunk < owner->chunk_list.size(); chunk++)
+            {
+                auto& current = owner->chunk_list[chunk];
+
+                if (current.size == 0)
+                {
+                    continue;
+                }
+
+                const auto data = current.buffer.get();
+
+                [&]<size_t... I>(std::index_sequence<I...>)
+                {
+                    (
+                        [&]
+                        {
+                            if constexpr (!std::is_const_v<Ts>)
+                            {
+                                current.version_list[slot_list[I]]++;
+                            }
+                        }(),
+                        ...);
+
+                    func(current.size, owner->entities(chunk), reinterpret_cast<Ts*>(data + offset_list[I])...);
+                }(std::index_sequence_for<Ts...>{});
+            }
+        }
+    }
+
+    template <typename... Ts>
+    size_type static_query<Ts...>::table_count() const
+    {
+        return binding_list_.size();
+    }
+
+    // tables are only ever appended to a registry, so a binding made once stays valid and only new tables are scanned.
+    template <typename... Ts>
+    void static_query<Ts...>::refresh()
+    {
+        const auto& table_list = registry_->table_list_;
+
+        for (; scanned_size_ < table_list.size(); scanned_size_++)
+        {
+            const auto owner = table_list[scanned_size_].get();
+
+            if (!owner->has_columns(sorted_type_index_list_))
+            {
+                continue;
+            }
+
+            binding current{.owner = owner};
+
+            for (size_type i = 0; i < type_count; i++)
+            {
+                current.slot_list[i] = owner->find_column(type_index_list_[i]);
+                current.offset_list[i] = owner->column_list[current.slot_list[i]].offset;
+            }
+
+            binding_list_.push_back(current);
+        }
+    }
+} // namespace nyx::ecs::detail
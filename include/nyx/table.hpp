@@ -7,15 +7,27 @@
 
 
 #include <algorithm>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <vector>
+
+#include <nyx/chunk_allocator.hpp>
+#include <nyx/dense_map.hpp>
 #include <nyx/hash.hpp>
 #include <nyx/sparse_set.hpp>
+#include <nyx/type_info.hpp>
 
 namespace nyx::ecs::detail
 {
-    struct entity_store
+    struct table;
+
+
+    struct entity_location
     {
-        size_type size;
-        std::byte* data;
+        table* owner;
+        size_type chunk;
+        size_type row;
     };
 
 
@@ -39,17 +51,417 @@ namespace nyx::ecs::detail
     };
 
 
+    struct table_column
+    {
+        size_type index;
+        size_type size;
+        size_type alignment;
+        size_type offset;
+        bool shared;
+    };
+
+
+    struct chunk_deleter
+    {
+        std::shared_ptr<chunk_allocator> allocator{};
+        size_type bytes{0};
+
+        void operator()(std::byte* data) const
+        {
+            if (allocator != nullptr)
+            {
+                allocator->deallocate(data, bytes);
+                return;
+            }
+
+            ::operator delete[](data, std::align_val_t{chunk_alignment});
+        }
+    };
+
+    using chunk_buffer = std::unique_ptr<std::byte[], chunk_deleter>;
+
+
+    // one chunk holds up to chunk_capacity rows, laid out column by column in a single buffer.
+    // shared columns keep a single value per chunk in a block at the front, which is also the chunk's shared key;
+    // the entity column follows, then every per-row component column at its aligned offset.
+    struct table_chunk
+    {
+        size_type size{0};
+        size_type node{invalid_id};
+        size_type entity_version{0};
+        chunk_buffer buffer{};
+        std::vector<size_type> version_list{};
+    };
+
+
     struct table
     {
         table_id id;
-        size_type size;
-        size_type entity_size;
-        size_type column_size;
-        sparse_set<entity_store> store_set{};
+        size_type size{0};
+        size_type index{invalid_id};
+        size_type entity_size{0};
+        size_type column_size{0};
+        size_type chunk_bytes{0};
+        size_type shared_size{0};
         std::vector<size_type> column_index_list{};
+        std::vector<table_column> column_list{};
+        std::vector<table_chunk> chunk_list{};
+        // chunks with room left. in a table with shared columns it only holds empty chunks, which take any key,
+        // while partly filled ones are kept per shared key in open_chunk_map so placing a row is a single lookup.
+        std::vector<size_type> open_chunk_list{};
+        dense_map<string, std::vector<size_type>> open_chunk_map{};
+        std::shared_ptr<chunk_allocator> allocator{};
+
+        table() = default;
+        table(const table_id& id, const std::vector<const type_info*>& type_info_list,
+              std::shared_ptr<chunk_allocator> allocator = nullptr);
+
+        [[nodiscard]] size_type find_column(size_type type_index) const;
+        [[nodiscard]] bool has_columns(const std::vector<size_type>& sorted_type_index_list) const;
+
+        entity* entities(size_type chunk);
+        std::byte* column(size_type slot, size_type chunk);
+        std::byte* get(size_type slot, size_type chunk, size_type row);
+        void touch(size_type slot, size_type chunk);
+
+        entity_location allocate(entity value, const std::byte* shared_key = nullptr);
+        entity deallocate(size_type chunk, size_type row);
+
+        // moves a chunk of source, which holds the same components, into this table and returns its new index.
+        // slot_list maps every source slot to a slot here. when both tables lay the chunk out the same way the buffer
+        // itself changes hands, its deleter still frees it through the source allocator; otherwise it is copied
+        // column by column. the entity ids are carried over unchanged.
+        size_type splice(table& source, size_type chunk, const std::vector<size_type>& slot_list);
+        // drops every chunk, the layout stays.
+        void clear();
+
+    private:
+        size_type entity_offset{0};
+
+        [[nodiscard]] string_view get_shared_key(size_type chunk);
+        size_type acquire_chunk(const std::byte* shared_key);
+        void open_chunk(size_type chunk);
+        void close_chunk(size_type chunk);
+        size_type create_chunk();
     };
 
 
+    inline table::table(const table_id& id, const std::vector<const type_info*>& type_info_list,
+                        std::shared_ptr<chunk_allocator> allocator) :
+        id(id), column_size(type_info_list.size()), column_index_list(id.sorted_column_index_list),
+        allocator(std::move(allocator))
+    {
+        auto sorted_type_info_list = type_info_list;
+        std::sort(sorted_type_info_list.begin(), sorted_type_info_list.end(),
+                  [](const type_info* lhs, const type_info* rhs) { return lhs->index < rhs->index; });
+
+        size_type offset = 0;
+
+        for (const auto info : sorted_type_info_list)
+        {
+            if (info->shared)
+            {
+                offset = (offset + info->alignment - 1) / info->alignment * info->alignment;
+                offset += info->size;
+            }
+        }
+
+        shared_size = offset;
+        entity_offset = (offset + alignof(entity) - 1) / alignof(entity) * alignof(entity);
+        offset = entity_offset + sizeof(entity) * chunk_capacity;
+        entity_size = sizeof(entity);
+
+        size_type shared_offset = 0;
+
+        for (const auto info : sorted_type_info_list)
+        {
+            if (info->shared)
+            {
+                shared_offset = (shared_offset + info->alignment - 1) / info->alignment * info->alignment;
+                column_list.push_back({info->index, info->size, info->alignment, shared_offset, true});
+                shared_offset += info->size;
+                continue;
+            }
+
+            offset = (offset + info->alignment - 1) / info->alignment * info->alignment;
+            column_list.push_back({info->index, info->size, info->alignment, offset, false});
+            offset += info->size * chunk_capacity;
+            entity_size += info->size;
+        }
+
+        chunk_bytes = (offset + chunk_alignment - 1) / chunk_alignment * chunk_alignment;
+    }
+
+    inline size_type table::find_column(const size_type type_index) const
+    {
+        const auto it = std::lower_bound(column_index_list.begin(), column_index_list.end(), type_index);
+
+        if (it == column_index_list.end() || *it != type_index)
+        {
+            return invalid_id;
+        }
+
+        return static_cast<size_type>(it - column_index_list.begin());
+    }
+
+    inline bool table::has_columns(const std::vector<size_type>& sorted_type_index_list) const
+    {
+        return std::includes(column_index_list.begin(), column_index_list.end(), sorted_type_index_list.begin(),
+                             sorted_type_index_list.end());
+    }
+
+    inline entity* table::entities(const size_type chunk)
+    {
+        return reinterpret_cast<entity*>(chunk_list[chunk].buffer.get() + entity_offset);
+    }
+
+    inline std::byte* table::column(const size_type slot, const size_type chunk)
+    {
+        return chunk_list[chunk].buffer.get() + column_list[slot].offset;
+    }
+
+    inline std::byte* table::get(const size_type slot, const size_type chunk, const size_type row)
+    {
+        if (column_list[slot].shared)
+        {
+            return column(slot, chunk);
+        }
+
+        return column(slot, chunk) + column_list[slot].size * row;
+    }
+
+    inline void table::touch(const size_type slot, const size_type chunk) { chunk_list[chunk].version_list[slot]++; }
+
+    // rows only land in chunks whose shared block matches shared_key, an empty chunk is re-keyed before reuse.
+    inline entity_location table::allocate(const entity value, const std::byte* shared_key)
+    {
+        const auto chunk = acquire_chunk(shared_key);
+        auto& target = chunk_list[chunk];
+        const auto row = target.size++;
+
+        if (target.size == chunk_capacity)
+        {
+            close_chunk(chunk);
+        }
+
+        entities(chunk)[row] = value;
+        target.entity_version++;
+        size++;
+
+        return {this, chunk, row};
+    }
+
+    // swap-removes the row inside its chunk and returns the entity moved into the hole, or invalid_id.
+    inline entity table::deallocate(const size_type chunk, const size_type row)
+    {
+        auto& target = chunk_list[chunk];
+        const auto tail = target.size - 1;
+        auto moved = invalid_id;
+
+        if (row != tail)
+        {
+            moved = entities(chunk)[tail];
+            entities(chunk)[row] = moved;
+
+            for (size_type slot = 0; slot < column_size; slot++)
+            {
+                if (column_list[slot].shared)
+                {
+                    continue;
+                }
+
+                std::memcpy(get(slot, chunk, row), get(slot, chunk, tail), column_list[slot].size);
+                touch(slot, chunk);
+            }
+        }
+
+        const auto full = target.size == chunk_capacity;
+
+        target.entity_version++;
+        target.size--;
+        size--;
+
+        // an emptied chunk leaves its key's list so any key can reuse it
+        if (shared_size != 0 && target.size == 0)
+        {
+            close_chunk(chunk);
+            open_chunk(chunk);
+        }
+        else if (full)
+        {
+            open_chunk(chunk);
+        }
+
+        return moved;
+    }
+
+    inline size_type table::splice(table& source, const size_type chunk, const std::vector<size_type>& slot_list)
+    {
+        auto& from = source.chunk_list[chunk];
+        const auto count = from.size;
+        auto same_layout = chunk_bytes == source.chunk_bytes && entity_offset == source.entity_offset;
+
+        for (size_type slot = 0; slot < source.column_size && same_layout; slot++)
+        {
+            same_layout = column_list[slot_list[slot]].offset == source.column_list[slot].offset;
+        }
+
+        auto index = invalid_id;
+
+        if (same_layout)
+        {
+            index = chunk_list.size();
+            auto& target = chunk_list.emplace_back();
+            target.node = from.node;
+            target.entity_version = from.entity_version;
+            target.buffer = std::move(from.buffer);
+            target.version_list.assign(column_size, 0);
+
+            for (size_type slot = 0; slot < source.column_size; slot++)
+            {
+                target.version_list[slot_list[slot]] = from.version_list[slot] + 1;
+            }
+        }
+        else
+        {
+            index = create_chunk();
+            std::memcpy(entities(index), source.entities(chunk), sizeof(entity) * count);
+            // the padding between shared values is part of the chunk key
+            std::memset(chunk_list[index].buffer.get(), 0, shared_size);
+
+            for (size_type slot = 0; slot < source.column_size; slot++)
+            {
+                const auto& column = source.column_list[slot];
+                std::memcpy(this->column(slot_list[slot], index), source.column(slot, chunk),
+                            column.shared ? column.size : column.size * count);
+                touch(slot_list[slot], index);
+            }
+        }
+
+        auto& target = chunk_list[index];
+        target.size = count;
+        target.entity_version++;
+        size += count;
+
+        if (count < chunk_capacity)
+        {
+            open_chunk(index);
+        }
+
+        from.size = 0;
+        source.size -= count;
+
+        return index;
+    }
+
+    inline void table::clear()
+    {
+        chunk_list.clear();
+        open_chunk_list.clear();
+        open_chunk_map.clear();
+        size = 0;
+    }
+
+    inline string_view table::get_shared_key(const size_type chunk)
+    {
+        return {reinterpret_cast<const char*>(chunk_list[chunk].buffer.get()), shared_size};
+    }
+
+    inline size_type table::acquire_chunk(const std::byte* shared_key)
+    {
+        if (shared_size == 0)
+        {
+            if (open_chunk_list.empty())
+            {
+                open_chunk_list.push_back(create_chunk());
+            }
+
+            return open_chunk_list.back();
+        }
+
+        const string_view key{reinterpret_cast<const char*>(shared_key), shared_size};
+
+        if (const auto list = open_chunk_map.get(key); list != nullptr)
+        {
+            return list->back();
+        }
+
+        auto chunk = invalid_id;
+
+        if (open_chunk_list.empty())
+        {
+            chunk = create_chunk();
+        }
+        else
+        {
+            chunk = open_chunk_list.back();
+            open_chunk_list.pop_back();
+        }
+
+        std::memcpy(chunk_list[chunk].buffer.get(), shared_key, shared_size);
+        open_chunk_map.set(key, std::vector{chunk});
+
+        return chunk;
+    }
+
+    // puts a chunk that just got room, or just got empty, back on its open list.
+    inline void table::open_chunk(const size_type chunk)
+    {
+        if (shared_size == 0 || chunk_list[chunk].size == 0)
+        {
+            open_chunk_list.push_back(chunk);
+            return;
+        }
+
+        const auto key = get_shared_key(chunk);
+
+        if (const auto list = open_chunk_map.get(key); list != nullptr)
+        {
+            list->push_back(chunk);
+            return;
+        }
+
+        open_chunk_map.set(key, std::vector{chunk});
+    }
+
+    // takes a chunk off the open list of its key; a key left without open chunks is dropped from the map.
+    inline void table::close_chunk(const size_type chunk)
+    {
+        const auto key_list = shared_size != 0 ? open_chunk_map.get(get_shared_key(chunk)) : nullptr;
+        auto& list = key_list != nullptr ? *key_list : open_chunk_list;
+
+        // the chunk taken last is almost always the one closed
+        const auto it = std::find(list.rbegin(), list.rend(), chunk);
+        *it = list.back();
+        list.pop_back();
+
+        if (key_list != nullptr && key_list->empty())
+        {
+            open_chunk_map.remove(get_shared_key(chunk));
+        }
+    }
+
+    inline size_type table::create_chunk()
+    {
+        auto& chunk = chunk_list.emplace_back();
+
+        if (allocator != nullptr)
+        {
+            chunk.node = allocator->select_node(chunk_list.size() - 1);
+            chunk.buffer = chunk_buffer(allocator->allocate(chunk_bytes, chunk.node), {allocator, chunk_bytes});
+        }
+        else
+        {
+            chunk.buffer = chunk_buffer(
+                static_cast<std::byte*>(::operator new[](chunk_bytes, std::align_val_t{chunk_alignment})));
+        }
+
+        chunk.version_list.assign(column_size, 0);
+
+        return chunk_list.size() - 1;
+    }
+
+
     constexpr size_type fnv_hash(const table_id& key)
     {
         size_type hash = fnv_helper<>::offset;
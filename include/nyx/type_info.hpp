@@ -7,16 +7,30 @@
 
 #include <source_location>
 #include <string>
+#include <vector>
 
 #include <nyx/common.h>
 
 namespace nyx::ecs::detail
 {
+    struct type_field
+    {
+        std::string name;
+        size_type offset;
+        size_type size;
+
+        bool operator==(const type_field&) const = default;
+    };
+
+
     struct type_info
     {
         size_type size;
         size_type index;
         std::string name;
         size_type alignment;
+        bool shared{false};
+        // only filled for components registered at runtime, static components leave it empty.
+        std::vector<type_field> field_list{};
     };
 } // namespace nyx::ecs::detail
@@ -0,0 +1,185 @@
+//
+// Created by loki7 on 25-7-8.
+//
+
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <nyx/chunk_allocator.hpp>
+#include <nyx/common.h>
+
+#if defined __linux__
+#include <pthread.h>
+#endif
+
+namespace nyx::ecs::detail
+{
+    // a fixed set of workers grouped by numa node. run() queues every item on its node, each worker drains its own
+    // node first and only then steals from the others.
+    class worker_pool
+    {
+    public:
+        using task_type = std::function<void(size_type item, size_type worker_node)>;
+
+        explicit worker_pool(numa_topology topology, size_type worker_per_node = 0);
+        ~worker_pool();
+
+        worker_pool(const worker_pool&) = delete;
+        worker_pool& operator=(const worker_pool&) = delete;
+
+        // blocks until task ran for every item, node_list holds the preferred node of each item.
+        void run(const std::vector<size_type>& node_list, const task_type& task);
+
+        [[nodiscard]] size_type worker_count() const;
+        [[nodiscard]] const numa_topology& topology() const;
+
+    private:
+        struct node_queue
+        {
+            std::vector<size_type> item_list;
+            std::atomic<size_type> cursor{0};
+        };
+
+        numa_topology topology_;
+        std::vector<std::thread> worker_list_{};
+        std::vector<node_queue> queue_list_;
+
+        std::mutex mutex_;
+        std::condition_variable wake_;
+        std::condition_variable done_;
+        size_type generation_{0};
+        size_type active_count_{0};
+        bool stopping_{false};
+        const task_type* task_{nullptr};
+
+        void work(size_type node);
+        void drain(size_type node);
+    };
+
+
+    inline worker_pool::worker_pool(numa_topology topology, const size_type worker_per_node) :
+        topology_(std::move(topology)), queue_list_(topology_.node_count)
+    {
+        for (size_type node = 0; node < topology_.node_count; node++)
+        {
+            const auto cpu_list = topology_.get_node_cpu_list(node);
+            const auto count = worker_per_node != 0 ? worker_per_node : std::max<size_type>(cpu_list.size(), 1);
+
+            for (size_type i = 0; i < count; i++)
+            {
+                auto& worker = worker_list_.emplace_back([this, node] { work(node); });
+
+#if defined __linux__
+                if (!topology_.fake && !cpu_list.empty())
+                {
+                    cpu_set_t cpu_set;
+                    CPU_ZERO(&cpu_set);
+
+                    for (const auto cpu : cpu_list)
+                    {
+                        CPU_SET(cpu, &cpu_set);
+                    }
+
+                    pthread_setaffinity_np(worker.native_handle(), sizeof(cpu_set), &cpu_set);
+                }
+#else
+                (void)worker;
+#endif
+            }
+        }
+    }
+
+    inline worker_pool::~worker_pool()
+    {
+        {
+            std::lock_guard lock(mutex_);
+            stopping_ = true;
+        }
+
+        wake_.notify_all();
+
+        for (auto& worker : worker_list_)
+        {
+            worker.join();
+        }
+    }
+
+    inline void worker_pool::run(const std::vector<size_type>& node_list, const task_type& task)
+    {
+        std::unique_lock lock(mutex_);
+
+        for (auto& queue : queue_list_)
+        {
+            queue.item_list.clear();
+            queue.cursor = 0;
+        }
+
+        for (size_type item = 0; item < node_list.size(); item++)
+        {
+            const auto node = validate_id(node_list[item]) ? node_list[item] : item;
+            queue_list_[node % topology_.node_count].item_list.push_back(item);
+        }
+
+        task_ = &task;
+        active_count_ = worker_list_.size();
+        generation_++;
+        wake_.notify_all();
+        done_.wait(lock, [this] { return active_count_ == 0; });
+        task_ = nullptr;
+    }
+
+    inline size_type worker_pool::worker_count() const { return worker_list_.size(); }
+
+    inline const numa_topology& worker_pool::topology() const { return topology_; }
+
+    inline void worker_pool::work(const size_type node)
+    {
+        size_type generation = 0;
+
+        while (true)
+        {
+            {
+                std::unique_lock lock(mutex_);
+                wake_.wait(lock, [&] { return stopping_ || generation_ != generation; });
+
+                if (stopping_)
+                {
+                    return;
+                }
+
+                generation = generation_;
+            }
+
+            drain(node);
+
+            {
+                std::lock_guard lock(mutex_);
+
+                if (--active_count_ == 0)
+                {
+                    done_.notify_one();
+                }
+            }
+        }
+    }
+
+    inline void worker_pool::drain(const size_type node)
+    {
+        for (size_type offset = 0; offset < queue_list_.size(); offset++)
+        {
+            auto& queue = queue_list_[(node + offset) % queue_list_.size()];
+
+            for (auto index = queue.cursor++; index < queue.item_list.size(); index = queue.cursor++)
+            {
+                (*task_)(queue.item_list[index], node);
+            }
+        }
+    }
+} // namespace nyx::ecs::detail
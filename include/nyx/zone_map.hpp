@@ -0,0 +1,97 @@
+//
+// Created by loki7 on 25-7-6.
+//
+
+
+#pragma once
+
+#include <concepts>
+#include <vector>
+
+#include <nyx/common.h>
+#include <nyx/table.hpp>
+
+namespace nyx::ecs::detail
+{
+    template <typename T>
+    struct zone_bounds
+    {
+        T min;
+        T max;
+        size_type version{invalid_id};
+    };
+
+
+    struct zone_map_base
+    {
+        virtual ~zone_map_base() = default;
+    };
+
+
+    // per-chunk min/max summaries of an ordered component column, rebuilt lazily once the column version moves.
+    template <std::totally_ordered T>
+    struct zone_map final : zone_map_base
+    {
+        const zone_bounds<T>& get(table& owner, size_type slot, size_type chunk);
+
+    private:
+        std::vector<std::vector<zone_bounds<T>>> bounds_list_{};
+    };
+
+
+    // writes the rows of values that fall inside [lo, hi] into selection and returns how many were selected.
+    template <std::totally_ordered T>
+    size_type select_range(const T* values, size_type count, const T& lo, const T& hi, size_type* selection)
+    {
+        size_type selected = 0;
+
+        for (size_type i = 0; i < count; i++)
+        {
+            selection[selected] = i;
+            selected += static_cast<size_type>(!(values[i] < lo) & !(hi < values[i]));
+        }
+
+        return selected;
+    }
+
+
+    template <std::totally_ordered T>
+    const zone_bounds<T>& zone_map<T>::get(table& owner, const size_type slot, const size_type chunk)
+    {
+        if (bounds_list_.size() <= owner.index)
+        {
+            bounds_list_.resize(owner.index + 1);
+        }
+
+        auto& table_bounds = bounds_list_[owner.index];
+
+        if (table_bounds.size() <= chunk)
+        {
+            table_bounds.resize(chunk + 1);
+        }
+
+        auto& bounds = table_bounds[chunk];
+        const auto& target = owner.chunk_list[chunk];
+
+        if (bounds.version == target.version_list[slot] || target.size == 0)
+        {
+            return bounds;
+        }
+
+        const auto values = reinterpret_cast<const T*>(owner.column(slot, chunk));
+        auto min = values[0];
+        auto max = values[0];
+
+        for (size_type i = 1; i < target.size; i++)
+        {
+            min = values[i] < min ? values[i] : min;
+            max = max < values[i] ? values[i] : max;
+        }
+
+        bounds.min = min;
+        bounds.max = max;
+        bounds.version = target.version_list[slot];
+
+        return bounds;
+    }
+} // namespace nyx::ecs::detail
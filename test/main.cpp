@@ -1,4 +1,9 @@
+#include <atomic>
+#include <barrier>
+#include <cassert>
 #include <iostream>
+#include <map>
+#include <mutex>
 #include <nyx/ecs.hpp>
 
 
@@ -16,9 +21,65 @@ struct vector_3d
 };
 
 
+struct health
+{
+    float value;
+
+    auto operator<=>(const health&) const = default;
+};
+
+
+struct material
+{
+    static constexpr bool shared = true;
+
+    int handle;
+};
+
+
+struct layer
+{
+    static constexpr bool shared = true;
+
+    std::uint8_t value;
+};
+
+
+struct palette
+{
+    static constexpr bool shared = true;
+
+    int handle;
+};
+
+
+// remembers the node every chunk was allocated for.
+struct node_recorder final : nyx::ecs::chunk_allocator
+{
+    std::shared_ptr<nyx::ecs::chunk_allocator> inner;
+    std::map<std::byte*, std::size_t> node_map{};
+    std::vector<std::size_t> node_list{};
+
+    explicit node_recorder(std::shared_ptr<nyx::ecs::chunk_allocator> inner) : inner(std::move(inner)) {}
+
+    std::size_t select_node(const std::size_t chunk_index) override { return inner->select_node(chunk_index); }
+
+    std::byte* allocate(const std::size_t bytes, const std::size_t node) override
+    {
+        const auto data = inner->allocate(bytes, node);
+        node_map[data] = node;
+        node_list.push_back(node);
+        return data;
+    }
+
+    void deallocate(std::byte* data, const std::size_t bytes) override { inner->deallocate(data, bytes); }
+};
+
+
 int main()
 {
     using namespace nyx::ecs;
+    using nyx::ecs::detail::invalid_id;
 
     registry registry;
     registry.get_type_info<vector_2d>();
@@ -28,5 +89,420 @@ int main()
     registry.get_matched_arch_types<vector_2d, vector_3d>();
 
 
+    for (int i = 0; i < 5000; i++)
+    {
+        registry.create(vector_2d{i, i}, health{static_cast<float>(i)});
+    }
+
+    const auto e = registry.create(vector_2d{-1, -1});
+    registry.emplace(e, vector_3d{1, 2});
+    registry.emplace(e, health{-10.0f});
+    assert(registry.get<vector_3d>(e)->y == 2);
+    registry.remove<vector_3d>(e);
+    assert(!registry.has<vector_3d>(e) && registry.get<vector_2d>(e)->x == -1);
+    registry.destroy(0);
+    assert(!registry.valid(0));
+
+    int matched = 0;
+    registry.each_in_range<health, const vector_2d>(health{100.0f}, health{199.0f},
+                                                    [&](entity, const health& h, const vector_2d& v)
+                                                    {
+                                                        assert(h.value >= 100.0f && h.value <= 199.0f);
+                                                        assert(v.x == static_cast<int>(h.value));
+                                                        matched++;
+                                                    });
+    assert(matched == 100);
+
+    registry.get<health>(4000)->value = 150.5f;
+    matched = 0;
+    registry.each_in_range<health>(health{150.0f}, health{151.0f}, [&](entity, const health&) { matched++; });
+    assert(matched == 3);
+
+    const auto first = registry.create(vector_2d{1, 1}, material{7});
+    const auto second = registry.create(vector_2d{2, 2}, material{8});
+    const auto third = registry.create(vector_2d{3, 3}, material{7});
+    registry.emplace(second, material{7});
+    registry.emplace(third, material{9});
+    assert(registry.get<const material>(second)->handle == 7 && registry.get<vector_2d>(third)->x == 3);
+
+    int chunks = 0;
+    registry.each_chunk<const vector_2d, const material>(
+        [&](std::span<entity> entities, std::span<const vector_2d> positions, const material& shared)
+        {
+            assert(entities.size() == positions.size());
+            assert(shared.handle == 7 ? entities.size() == 2 : entities.size() == 1 && entities[0] == third);
+            chunks++;
+        });
+    assert(chunks == 2 && registry.has<material>(first));
+
+    const std::vector<entity> targets{first, 100000, 4999, third};
+    std::vector<std::tuple<vector_2d*, const health*>> rows(targets.size());
+    registry.get_many<vector_2d, const health>(targets, rows);
+    assert(std::get<0>(rows[0])->x == 1 && std::get<1>(rows[0]) == nullptr && std::get<0>(rows[1]) == nullptr);
+    assert(std::get<1>(rows[2])->value == 4999.0f);
+
+    std::vector<std::tuple<vector_2d>> copies(targets.size());
+    [[maybe_unused]] const auto copied = registry.copy_many<vector_2d>(targets, copies);
+    assert(copied == 3 && std::get<0>(copies[3]).x == 3);
+
+    std::vector<std::pair<observer_event, std::vector<entity>>> batches;
+    const auto record = [&](const observer_event event)
+    {
+        return [&batches, event](std::span<const entity> values)
+        { batches.emplace_back(event, std::vector(values.begin(), values.end())); };
+    };
+    registry.observe<vector_3d>(observer_event::add, record(observer_event::add));
+    const auto removed = registry.observe<vector_3d>(observer_event::remove, record(observer_event::remove));
+    registry.observe<vector_3d>(observer_event::change, record(observer_event::change));
+    registry.flush_observers();
+    assert(batches.empty());
+
+    // the add of observed is cancelled by its destroy, the recycled id comes back as a plain add
+    const auto observed = registry.create(vector_3d{0, 0});
+    registry.emplace(first, vector_3d{1, 1});
+    [[maybe_unused]] const auto patched = registry.patch<vector_3d>(first, [](vector_3d& v) { v.y = 5; });
+    registry.destroy(observed);
+    const auto recycled = registry.create();
+    registry.emplace(recycled, vector_3d{2, 2});
+    [[maybe_unused]] const auto missing = registry.patch<vector_3d>(second, [](auto&) {});
+    assert(batches.empty() && patched && !missing && registry.get<vector_3d>(first)->y == 5);
+
+    registry.flush_observers();
+    assert(recycled == observed && batches.size() == 2);
+    assert(batches[0].first == observer_event::add && batches[0].second == std::vector<entity>({first, observed}));
+    assert(batches[1].first == observer_event::change && batches[1].second == std::vector<entity>({first}));
+
+    // interleaved adds and changes still arrive as one span per kind
+    batches.clear();
+    std::vector<entity> spawned;
+
+    for (int i = 0; i < 1000; i++)
+    {
+        spawned.push_back(registry.create(vector_3d{i, i}));
+        registry.patch<vector_3d>(spawned.back(), [](vector_3d& v) { v.x++; });
+    }
+
+    registry.destroy(spawned.front());
+    registry.flush_observers();
+    assert(batches.size() == 2 && batches[0].second.size() == 999 && batches[1].second.size() == 999);
+
+    [[maybe_unused]] const auto unobserved = registry.unobserve(removed);
+    [[maybe_unused]] const auto unobserved_again = registry.unobserve(removed);
+    assert(unobserved && !unobserved_again);
+    batches.clear();
+
+    for (const auto value : spawned)
+    {
+        registry.destroy(value);
+    }
+
+    registry.remove<vector_3d>(first);
+    registry.flush_observers();
+    assert(batches.empty());
+
+    static_assert(static_query<health, const vector_2d>::signature[0] == "health");
+    static_query<vector_2d, const health> healthy(registry);
+    double dynamic_total = 0;
+    double static_total = 0;
+    registry.each<const vector_2d, const health>([&](entity, const vector_2d& v, const health& h)
+                                                 { dynamic_total += v.x + h.value; });
+    healthy.each([&](entity, vector_2d& v, const health& h) { static_total += v.x++ + h.value; });
+    assert(static_total == dynamic_total && registry.get<vector_2d>(4999)->x == 5000);
+
+    std::size_t static_rows = 0;
+    registry.create(vector_2d{0, 0}, health{0.0f}, vector_3d{0, 0});
+    static_query<const vector_2d, const material>(registry).each_chunk(
+        [&](std::span<entity> entities, std::span<const vector_2d>, const material&)
+        { static_rows += entities.size(); });
+    healthy.each_chunk([&](std::span<entity> entities, std::span<vector_2d>, std::span<const health>)
+                       { static_rows += entities.size(); });
+    assert(static_rows == 3 + 5001 && healthy.table_count() == 2);
+
+    const std::vector<type_field> velocity_fields{{"dx", 0, 4}, {"dy", 4, 4}};
+    const auto velocity = registry.register_type("script::velocity", 8, 4, velocity_fields);
+    [[maybe_unused]] const auto same_velocity = registry.register_type("script::velocity", 8, 4, velocity_fields);
+    [[maybe_unused]] const auto resized_velocity = registry.register_type("script::velocity", 12, 4, velocity_fields);
+    [[maybe_unused]] const auto swapped_velocity =
+        registry.register_type("script::velocity", 8, 4, {{"dx", 4, 4}, {"dy", 0, 4}});
+    [[maybe_unused]] const auto broken = registry.register_type("script::broken", 4, 4, {{"x", 2, 4}});
+    assert(velocity != nullptr && velocity->field_list.size() == 2 && same_velocity == velocity);
+    assert(resized_velocity == nullptr && swapped_velocity == nullptr && broken == nullptr);
+
+    std::size_t emplaced = 0;
+
+    for (entity value = 1; value <= 100; value++)
+    {
+        const int data[2]{static_cast<int>(value), 1};
+        emplaced += registry.emplace(value, velocity->index, data) ? 1 : 0;
+    }
+
+    assert(emplaced == 100);
+
+    const auto position_index = registry.get_type_info<vector_2d>()->index;
+    dynamic_query scripted(registry, {{velocity->index, true}, {position_index}});
+    std::size_t script_calls = 0;
+    scripted.each_chunk(
+        [&](std::span<entity> entities, std::span<const dynamic_column> columns)
+        {
+            const auto dx = columns[0].field_list[0].offset;
+
+            for (std::size_t row = 0; row < entities.size(); row++)
+            {
+                int step;
+                std::memcpy(&step, columns[0].get(row) + dx, sizeof(step));
+                reinterpret_cast<vector_2d*>(columns[1].get(row))->y = step;
+            }
+
+            script_calls++;
+        });
+    assert(script_calls == 1 && scripted.valid() && registry.get<vector_2d>(57)->y == 57);
+
+    [[maybe_unused]] const auto had_velocity = registry.has(57, velocity->index);
+    [[maybe_unused]] const auto removed_velocity = registry.remove(57, velocity->index);
+    [[maybe_unused]] const auto velocity_data = registry.get(58, velocity->index);
+    assert(had_velocity && removed_velocity && !registry.has(57, velocity->index));
+    assert(reinterpret_cast<const int*>(velocity_data)[1] == 1);
+
+    // shared columns are chunk keys, a query may only read them
+    [[maybe_unused]] const auto material_index = registry.get_type_info<material>()->index;
+    assert(!dynamic_query(registry, {{material_index}}).valid());
+    assert(dynamic_query(registry, {{material_index, true}}).valid());
+
+    nyx::ecs::registry staging;
+    std::thread builder(
+        [&]
+        {
+            // health before vector_2d: that table gets a different layout and is copied, the vector_3d one is spliced
+            for (int i = 0; i < 1500; i++)
+            {
+                staging.create(health{1.0f}, vector_2d{i, -i});
+            }
+
+            for (int i = 0; i < 10; i++)
+            {
+                staging.create(vector_3d{i, i});
+            }
+        });
+    builder.join();
+
+    [[maybe_unused]] const auto spliced = staging.get<vector_3d>(1505);
+    const auto remap = *registry.merge(staging);
+    assert(remap.size() == 1510 && registry.get<vector_3d>(remap[1505]) == spliced);
+    assert(registry.get<vector_2d>(remap[7])->y == -7 && registry.get<health>(remap[1499])->value == 1.0f);
+    assert(!staging.valid(0));
+
+    [[maybe_unused]] const auto restaged = staging.create(vector_3d{});
+    assert(restaged == 0 && staging.get<vector_3d>(0) != nullptr);
+
+    // same name and size, but fields at other offsets: nothing is merged
+    nyx::ecs::registry conflicting;
+    conflicting.register_type("script::velocity", 8, 4, {{"dx", 4, 4}, {"dy", 0, 4}});
+    conflicting.create();
+    const auto conflict_remap = registry.merge(conflicting);
+    assert(!conflict_remap && conflicting.valid(0));
+    nyx::ecs::registry empty_staging;
+    const auto empty_remap = registry.merge(empty_staging);
+    assert(empty_remap && empty_remap->empty());
+
+    // the shared blocks are laid out in opposite orders, so the chunk is copied and the padding has to be cleared
+    registry.get_type_info<layer>();
+    registry.get_type_info<palette>();
+    nyx::ecs::registry keyed_staging;
+    keyed_staging.get_type_info<palette>();
+    keyed_staging.create(vector_2d{}, layer{1}, palette{2});
+    [[maybe_unused]] const auto keyed_remap = registry.merge(keyed_staging);
+    registry.create(vector_2d{}, layer{1}, palette{2});
+    int keyed_chunks = 0;
+    registry.each_chunk<const vector_2d, const layer, const palette>(
+        [&](std::span<entity> entities, std::span<const vector_2d>, const layer&, const palette&)
+        {
+            assert(entities.size() == 2);
+            keyed_chunks++;
+        });
+    assert(keyed_remap && keyed_chunks == 1);
+
+    {
+        auto topology = numa_topology::create_fake(2, 2);
+        nyx::ecs::registry numa_registry;
+        const auto recorder = std::make_shared<node_recorder>(
+            std::make_shared<numa_chunk_allocator>(topology, chunk_placement::interleave, 0, true));
+        numa_registry.set_chunk_allocator(recorder);
+        worker_pool pool(topology);
+
+        for (int i = 0; i < 10000; i++)
+        {
+            numa_registry.create(vector_2d{i, i});
+        }
+
+        std::atomic<int> rows = 0;
+        numa_registry.each_chunk_parallel<vector_2d>(pool,
+                                                     [&](std::span<entity> entities, std::span<vector_2d> positions)
+                                                     {
+                                                         for (auto& position : positions)
+                                                         {
+                                                             position.y++;
+                                                         }
+
+                                                         rows += static_cast<int>(entities.size());
+                                                     });
+        assert(rows == 10000 && numa_registry.get<vector_2d>(9999)->y == 10000);
+        assert(recorder->node_list == std::vector<std::size_t>({0, 1, 0, 1, 0, 1, 0, 1, 0, 1}));
+
+        // one worker per node moving in lockstep can not run out of work early, so nothing is stolen and every
+        // chunk has to run on a worker of the node its memory lives on
+        worker_pool paired(topology, 1);
+        std::barrier lockstep(2);
+        std::mutex worker_mutex;
+        std::map<std::thread::id, std::size_t> worker_node_map;
+        std::atomic<int> misplaced = 0;
+        paired.run(recorder->node_list,
+                   [&](const std::size_t item, const std::size_t worker_node)
+                   {
+                       misplaced += worker_node != recorder->node_list[item] ? 1 : 0;
+                       {
+                           std::lock_guard lock(worker_mutex);
+                           worker_node_map[std::this_thread::get_id()] = worker_node;
+                       }
+                       lockstep.arrive_and_wait();
+                   });
+        numa_registry.each_chunk_parallel<const vector_2d>(
+            paired,
+            [&](std::span<entity> entities, std::span<const vector_2d>)
+            {
+                const auto chunk_node = recorder->node_map.at(reinterpret_cast<std::byte*>(entities.data()));
+                misplaced += worker_node_map.at(std::this_thread::get_id()) != chunk_node ? 1 : 0;
+                lockstep.arrive_and_wait();
+            });
+        assert(misplaced == 0 && worker_node_map.size() == 2);
+
+        // chunks below a huge page share huge page slabs per node, a freed chunk is handed out again
+        numa_chunk_allocator slabs(topology, chunk_placement::interleave, 0, true);
+        [[maybe_unused]] const auto slab_page = [](const std::byte* data)
+        { return reinterpret_cast<std::uintptr_t>(data) / numa_chunk_allocator::huge_page_size; };
+        const auto first_block = slabs.allocate(16384, 0);
+        [[maybe_unused]] const auto second_block = slabs.allocate(16384, 0);
+        [[maybe_unused]] const auto remote_block = slabs.allocate(16384, 1);
+        assert(second_block == first_block + 16384 && slab_page(first_block) == slab_page(second_block));
+        assert(slab_page(remote_block) != slab_page(first_block));
+        slabs.deallocate(first_block, 16384);
+        [[maybe_unused]] const auto reused = slabs.allocate(16384, 0);
+        assert(reused == first_block);
+
+        hierarchy<int> offsets;
+        const auto add = [](const int parent, const int local) { return parent + local; };
+
+        for (entity node = 0; node < 20000; node++)
+        {
+            offsets.insert(node, 1, node == 0 ? invalid_id : (node - 1) / 4);
+        }
+
+        offsets.propagate(pool, add, 256);
+        assert(*offsets.get_world(0) == 1 && *offsets.get_world(5) == 3 && offsets.get_depth(19999) == 7);
+
+        [[maybe_unused]] const auto moved = offsets.reparent(1, 19999);
+        [[maybe_unused]] const auto cyclic = offsets.reparent(19999, 5);
+        assert(moved && !cyclic);
+        offsets.remove(2);
+        offsets.optimize();
+        offsets.propagate(add);
+        assert(offsets.get_depth(5) == 9 && *offsets.get_world(5) == 10 && !offsets.contains(9));
+        assert(*offsets.get_world(19998) == 8 && offsets.get_parent(1) == 19999);
+
+        // inserting an entity twice is rejected and leaves its links intact
+        hierarchy<int> twice;
+        twice.insert(0, 1);
+        twice.insert(1, 1, 0);
+        [[maybe_unused]] const auto duplicated = twice.insert(1, 5, 0);
+        assert(!duplicated && *twice.get_local(1) == 1 && twice.get_level(1).size() == 1);
+        [[maybe_unused]] const auto orphaned = twice.insert(5, 1, 99);
+        assert(!orphaned && !twice.contains(5) && twice.get_level(0).size() == 1);
+        twice.remove(0);
+        assert(!twice.contains(1) && twice.level_count() == 0);
+
+        snapshot_buffer buffer;
+        buffer.publish(numa_registry.take_snapshot<vector_2d>());
+        numa_registry.get<vector_2d>(42)->x = -42;
+        buffer.publish(numa_registry.take_snapshot<vector_2d>(buffer.acquire()));
+
+        std::thread reader(
+            [&]
+            {
+                const auto frame = buffer.acquire();
+                int total = 0;
+                frame->each<vector_2d>(
+                    [&](const entity value, const vector_2d& position)
+                    {
+                        assert(value != 42 || position.x == -42);
+                        total++;
+                    });
+                assert(frame->frame() == 1 && total == 10000 && frame->copy_count() == 1);
+            });
+        numa_registry.get<vector_2d>(42)->x = 42;
+        reader.join();
+
+        const auto base = buffer.acquire();
+        numa_registry.destroy(7);
+        numa_registry.create(vector_2d{7, 7}, health{7.0f});
+        const auto next = numa_registry.take_snapshot<vector_2d>(base);
+        const auto delta = snapshot_delta::encode(base.get(), *next);
+        const auto full = snapshot_delta::encode(nullptr, *next);
+        const auto replica = snapshot_delta::create(full.data()).apply(nullptr);
+        const auto rolled = delta.apply(base.get());
+        assert(delta.size() < 128 && delta.size() < full.size() / 100 && rolled->size() == next->size());
+
+        std::vector<std::tuple<entity, int, int>> expected;
+        next->each<vector_2d>([&](const entity value, const vector_2d& v) { expected.emplace_back(value, v.x, v.y); });
+
+        for (const auto& decoded : {rolled, replica})
+        {
+            [[maybe_unused]] std::size_t row = 0;
+            decoded->each<vector_2d>(
+                [&](const entity value, const vector_2d& v)
+                { assert(expected[row++] == std::make_tuple(value, v.x, v.y)); });
+            assert(row == expected.size());
+        }
+
+        // a truncated stream is rejected instead of read past its end
+        const auto half = full.data().first(full.size() / 2);
+        assert(snapshot_delta::create(half).apply(nullptr) == nullptr);
+        assert(snapshot_delta::create(delta.data().first(delta.size() - 1)).apply(base.get()) == nullptr);
+
+        // a forged stream naming vector_2d with a one byte element decodes, but is not read as vector_2d
+        const auto header = full.data().first(3 + std::to_integer<std::size_t>(full.data()[2]));
+        std::vector<std::byte> forged(header.begin(), header.end());
+        const auto append = [&](std::size_t value)
+        {
+            for (; value >= 0x80; value >>= 7)
+            {
+                forged.push_back(static_cast<std::byte>(value | 0x80));
+            }
+            forged.push_back(static_cast<std::byte>(value));
+        };
+        const auto name_size = forged.size();
+
+        for (const auto value : std::initializer_list<std::size_t>{1, 0, 0, 0, 1, 1, 0, 1, 1, 0, 1, 1})
+        {
+            append(value);
+        }
+
+        const auto narrow = snapshot_delta::create(forged).apply(nullptr);
+        std::size_t narrow_rows = 0;
+        narrow->each<vector_2d>([&](entity, const vector_2d&) { narrow_rows++; });
+        assert(narrow->size() == 1 && narrow_rows == 0);
+
+        // an element size past any real column is rejected before anything is allocated for it
+        forged.resize(name_size);
+
+        const auto huge = std::size_t{1} << 50;
+
+        for (const auto value : std::initializer_list<std::size_t>{huge, 0, 0, 0, 1, 1, 0, 1, huge, 0, 1, 1})
+        {
+            append(value);
+        }
+
+        assert(snapshot_delta::create(forged).apply(nullptr) == nullptr);
+    }
+
+
     return 0;
 }